@@ -45,16 +45,19 @@ static const size_t wsize = sizeof(word_t);
 static const size_t dsize = 2 * sizeof(word_t);
 
 /*
-  Minimum useable block size (bytes):
-  two words for header & footer, two words for payload
+  Minimum useable block size (bytes) is the mini block size:
+  one word for header, one word for payload. A free mini block has no
+  room for a footer, so its successor finds it through the prev_mini bit.
 */
-static const size_t min_block_size = 4 * sizeof(word_t);
+static const size_t mini_block_size = 2 * sizeof(word_t);
 
 // Mask to extract allocated bit from header
 static const word_t alloc_mask = 0x1;
 
 static const word_t prev_alloc_mask = 0b10;
 
+static const word_t prev_mini_mask = 0b100;
+
 /*
  * Assume: All block sizes are a multiple of 16
  * and so can use lower 4 bits for flags
@@ -64,11 +67,14 @@ static const word_t size_mask = ~(word_t) 0xF;
 static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
 
 /*
-  All blocks have both headers and footers
+  Only free blocks have footers, allocated blocks have just a header.
+  Mini blocks never have a footer.
 
   Both the header and the footer consist of a single word containing the
-  size and the allocation flag, where size is the total size of the block,
-  including header, (possibly payload), unused space, and footer
+  size, the allocation flag, the allocation flag of the previous block and
+  whether the previous block is a mini block, where size is the total size
+  of the block, including header, (possibly payload), unused space, and
+  footer
 */
 
 /* Representation of the header and payload of one block in the heap */
@@ -99,11 +105,11 @@ static block_t * (*find_fit)(size_t asize);
 static block_t *first_fit(size_t asize);
 static block_t *next_fit(size_t asize);
 static block_t *best_fit(size_t asize);
-static void coalesce_block(block_t *block);
+static block_t *coalesce_block(block_t *block);
 static void split_block(block_t *block, size_t asize);
 
 static size_t round_up(size_t size, size_t n);
-static word_t pack(size_t size, bool alloc, bool prev_alloc);
+static word_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini);
 
 static size_t extract_size(word_t header);
 static size_t get_size(block_t *block);
@@ -112,9 +118,12 @@ static bool extract_alloc(word_t header);
 static bool get_alloc(block_t *block);
 static bool Is_prev_alloc(block_t *block);
 static bool extract_prev_alloc(word_t word);
+static void set_prev_alloc(block_t *block, bool prev_alloc);
+static bool Is_prev_mini(block_t *block);
+static void set_prev_mini(block_t *block, bool prev_mini);
 
-static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc);
-static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc);
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini);
+static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini);
 
 static block_t *payload_to_header(void *bp);
 static void *header_to_payload(block_t *block);
@@ -129,11 +138,12 @@ static word_t get_payload_size(block_t *block);
 
 void log_block(block_t *block){
 	bool is_allocated = get_alloc(block);
-	printf("Block address %p,  size = %zd, allocated = %s, prev_allocated = %s",
+	printf("Block address %p,  size = %zd, allocated = %s, prev_allocated = %s, prev_mini = %s",
 	       block,
 	       get_size(block),
 	       is_allocated ? "Y" : "N",
-	       Is_prev_alloc(block) ? "Y" : "N");
+	       Is_prev_alloc(block) ? "Y" : "N",
+	       Is_prev_mini(block) ? "Y" : "N");
 
 	printf("\n");
 }
@@ -151,8 +161,10 @@ int mm_init()
 		return -1;
 	}
 
-	start[0] = pack(0, true, true); // Prologue footer
-	start[1] = pack(0, true, true); // Epilogue header
+	start[0] = pack(0, true, true, false); // Prologue footer
+	start[1] = pack(0, true, true, false); // Epilogue header
+
+	next_fit_ptr = NULL;
 
 	// Extend the empty heap with a free block of chunksize bytes
 	if ((heap_start = extend_heap(chunksize)) == NULL)
@@ -184,23 +196,25 @@ void *mm_malloc(size_t size)
 	if (size == 0) // Ignore spurious request
 		return bp;
 
-	// !!!!!
-	// only one header but no footer for allocated block
+	// only one header but no footer for allocated block,
+	// payloads of up to one word fit a mini block
 	asize = round_up(size + wsize, dsize);
 
-	while((block = find_fit(asize)) == NULL) {
-		extend_heap(chunksize);
+	if((block = find_fit(asize)) == NULL) {
+		// Nothing fits, grow the heap
+		size_t extend_size = asize > chunksize ? asize : chunksize;
+		if((block = extend_heap(extend_size)) == NULL) {
+			return NULL;
+		}
 	}
 
-	// Mark block as allocated
+	// Mark block as allocated, no need to write footer
 	size_t block_size = get_size(block);
-	write_header(block, block_size, true, Is_prev_alloc(block));
-	// !!!!!
-	//	 no need to write footer
-	//	 write_footer(block, block_size, true);
+	write_header(block, block_size, true, Is_prev_alloc(block), Is_prev_mini(block));
 
 	// Try to split the block if too large
 	split_block(block, asize);
+	set_prev_alloc(find_next(block), true);
 	bp = header_to_payload(block);
 
 	return bp;
@@ -223,8 +237,10 @@ void mm_free(void *bp)
 	}
 
 	// Mark the block as free
-	write_header(block, size, false, Is_prev_alloc(block));
-	write_footer(block, size, false, Is_prev_alloc(block));
+	bool is_prev_allocated = Is_prev_alloc(block);
+	bool is_prev_mini = Is_prev_mini(block);
+	write_header(block, size, false, is_prev_allocated, is_prev_mini);
+	write_footer(block, size, false, is_prev_allocated, is_prev_mini);
 
 	// Try to coalesce the block with its neighbors
 	coalesce_block(block);
@@ -238,18 +254,18 @@ void *mm_realloc(void *ptr, size_t size) {
 	// If size == 0, then free block and return NULL
 	if (size == 0)
 	{
-		free(ptr);
+		mm_free(ptr);
 		return NULL;
 	}
 
 	// If ptr is NULL, then equivalent to malloc
 	if (ptr == NULL)
 	{
-		return malloc(size);
+		return mm_malloc(size);
 	}
 
 	// Otherwise, proceed with reallocation
-	newptr = malloc(size);
+	newptr = mm_malloc(size);
 	// If malloc fails, the original block is left untouched
 	if (!newptr)
 	{
@@ -265,21 +281,31 @@ void *mm_realloc(void *ptr, size_t size) {
 	memcpy(newptr, ptr, copysize);
 
 	// Free the old block
-	free(ptr);
+	mm_free(ptr);
 
 	return newptr;
 }
 
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
 /* Print status of every block in heap */
 void mm_status(FILE *fp) {
 	block_t *block = heap_start;
 	printf("*******************************\n");
 	while (block != heap_end) {
-		fprintf(fp, " Block address %p,  size = %zd, allocated = %s, prev_allocated = %s\n",
+		fprintf(fp, " Block address %p,  size = %zd, allocated = %s, prev_allocated = %s, prev_mini = %s\n",
 		        block,
 		        get_size(block),
 		        get_alloc(block) ? "Y" : "N",
-		        Is_prev_alloc(block) ? "Y" : "N");
+		        Is_prev_alloc(block) ? "Y" : "N",
+		        Is_prev_mini(block) ? "Y" : "N");
 		block = find_next(block);
 	}
 	fprintf(fp, "Heap end address %p,  size = %zd, allocated = %s, prev_allocated = %s\n",
@@ -296,19 +322,25 @@ void mm_status(FILE *fp) {
 
 
 /*
- * Attempt to coalesce block with its predecessor and successor
+ * Attempt to coalesce block with its predecessor and successor.
+ * Returns the coalesced block, and tells the block after it that its
+ * predecessor is now free and whether it is a mini block.
  */
-static void coalesce_block(block_t *block)
+static block_t *coalesce_block(block_t *block)
 {
 
 	size_t size = get_size(block);
 
 	block_t *block_next = find_next(block);
-	block_t *block_prev = find_prev(block);
+	block_t *block_prev = NULL;
 
 	bool prev_alloc = Is_prev_alloc(block);
 	bool next_alloc = get_alloc(block_next);
 
+	// the previous block can only be located when it is free
+	if (!prev_alloc)
+		block_prev = find_prev(block);
+
 	if (prev_alloc && next_alloc)              // Case 1
 	{
 		// Nothing to do
@@ -317,26 +349,39 @@ static void coalesce_block(block_t *block)
 	else if (prev_alloc && !next_alloc)        // Case 2
 	{
 		size += get_size(block_next);
-		write_header(block, size, false, prev_alloc);
-		write_footer(block, size, false, prev_alloc);
+		bool Is_prev_mini_block = Is_prev_mini(block);
+		write_header(block, size, false, prev_alloc, Is_prev_mini_block);
+		write_footer(block, size, false, prev_alloc, Is_prev_mini_block);
 	}
 
 	else if (!prev_alloc && next_alloc)        // Case 3
 	{
 		size += get_size(block_prev);
 		bool Is_prev_prev_alloc = Is_prev_alloc(block_prev);
-		write_header(block_prev, size, false, Is_prev_prev_alloc);
-		write_footer(block_prev, size, false, Is_prev_prev_alloc);
+		bool Is_prev_prev_mini = Is_prev_mini(block_prev);
+		write_header(block_prev, size, false, Is_prev_prev_alloc, Is_prev_prev_mini);
+		write_footer(block_prev, size, false, Is_prev_prev_alloc, Is_prev_prev_mini);
 		block = block_prev;
 	}
 
 	else                                        // Case 4
 	{
 		size += get_size(block_next) + get_size(block_prev);
-		write_header(block_prev, size, false, Is_prev_alloc(block_prev));
-		write_footer(block_prev, size, false, Is_prev_alloc(block_prev));
+		bool Is_prev_prev_alloc = Is_prev_alloc(block_prev);
+		bool Is_prev_prev_mini = Is_prev_mini(block_prev);
+		write_header(block_prev, size, false, Is_prev_prev_alloc, Is_prev_prev_mini);
+		write_footer(block_prev, size, false, Is_prev_prev_alloc, Is_prev_prev_mini);
 		block = block_prev;
 	}
+
+	set_prev_alloc(find_next(block), false);
+	set_prev_mini(find_next(block), size == mini_block_size);
+
+	// the next fit pointer must not stay inside the merged block
+	if (next_fit_ptr != NULL && next_fit_ptr > block && next_fit_ptr < find_next(block))
+		next_fit_ptr = block;
+
+	return block;
 }
 
 
@@ -348,14 +393,18 @@ static void split_block(block_t *block, size_t asize)
 {
 	size_t block_size = get_size(block);
 
-	if ((block_size - asize) >= min_block_size)
+	if ((block_size - asize) >= mini_block_size)
 	{
 		block_t *block_next;
-		write_header(block, asize, true, Is_prev_alloc(block));
+		write_header(block, asize, true, Is_prev_alloc(block), Is_prev_mini(block));
 
 		block_next = find_next(block);
-		write_header(block_next, block_size - asize, false, true);
-		write_footer(block_next, block_size - asize, false, true);
+		bool is_prev_mini = (asize == mini_block_size);
+		write_header(block_next, block_size - asize, false, true, is_prev_mini);
+		write_footer(block_next, block_size - asize, false, true, is_prev_mini);
+
+		// the block after the remainder still sees a free predecessor
+		set_prev_mini(find_next(block_next), block_size - asize == mini_block_size);
 	}
 }
 
@@ -419,24 +468,28 @@ static block_t *extend_heap(size_t size)
 
 	// Allocate an even number of words to maintain alignment
 	size = round_up(size, dsize);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
 	if ((bp = mem_sbrk(size)) == (void *)-1)
 	{
 		return NULL;
 	}
 
-	// Initialize free block header/footer
+	// Initialize free block header/footer, the old epilogue knows
+	// the status of the last block
 	block_t *block = payload_to_header(bp);
-	bool is_prev_allocate = extract_alloc(*find_prev_footer(block));
-	write_header(block, size, false, is_prev_allocate);
-	write_footer(block, size, false, is_prev_allocate);
+	bool is_prev_allocate = Is_prev_alloc(block);
+	bool is_prev_mini = Is_prev_mini(block);
+	write_header(block, size, false, is_prev_allocate, is_prev_mini);
+	write_footer(block, size, false, is_prev_allocate, is_prev_mini);
 	// Create new epilogue header
 	block_t *block_next = find_next(block);
-	write_header(block_next, 0, true, false);
+	write_header(block_next, 0, true, false, false);
 	heap_end = block_next;
 
 	// Coalesce in case the previous block was free
-	coalesce_block(block);
-	return block;
+	return coalesce_block(block);
 }
 
 /*
@@ -459,8 +512,10 @@ static size_t round_up(size_t size, size_t n)
 /*
  * pack: returns a header reflecting a specified size and its alloc status.
  *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ *       If the previous block is allocated, the second bit is set to 1.
+ *       If the previous block is a mini block, the third bit is set to 1.
  */
-static word_t pack(size_t size, bool alloc, bool prev_alloc)
+static word_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
 	word_t result = size;
 
@@ -472,6 +527,10 @@ static word_t pack(size_t size, bool alloc, bool prev_alloc)
 		result |= prev_alloc_mask;
 	}
 
+	if(prev_mini) {
+		result |= prev_mini_mask;
+	}
+
 	return result;
 }
 
@@ -523,32 +582,66 @@ static bool Is_prev_alloc(block_t *block)
 	return extract_prev_alloc(block->header);
 }
 
+/*
+ * set_prev_alloc: updates only the previous-block-allocated bit of the
+ *                 block header, leaving the size and alloc status alone.
+ */
+static void set_prev_alloc(block_t *block, bool prev_alloc)
+{
+	if(prev_alloc) {
+		block->header |= prev_alloc_mask;
+	}else{
+		block->header &= ~prev_alloc_mask;
+	}
+}
+
+static bool Is_prev_mini(block_t *block)
+{
+	return (bool) (block->header & prev_mini_mask);
+}
+
+/*
+ * set_prev_mini: updates only the previous-block-is-mini bit of the
+ *                block header.
+ */
+static void set_prev_mini(block_t *block, bool prev_mini)
+{
+	if(prev_mini) {
+		block->header |= prev_mini_mask;
+	}else{
+		block->header &= ~prev_mini_mask;
+	}
+}
+
 
 
 /*
  * write_header: given a block and its size and allocation status,
  *               writes an appropriate value to the block header.
  */
-static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc)
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
-	block->header = pack(size, alloc, prev_alloc);
+	block->header = pack(size, alloc, prev_alloc, prev_mini);
 }
 
 
 /*
  * write_footer: given a block and its size and allocation status,
  *               writes an appropriate value to the block footer by first
- *               computing the position of the footer.
+ *               computing the position of the footer. Mini blocks have
+ *               no footer, so nothing is written for them.
  */
-static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc)
+static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
 	if(get_alloc(block)) {
 		printf("!!!!! Wrong, try to write foot on a allocated block !!!!!\n");
 		log_block(block);
 	}
 
+	if(size == mini_block_size) return;
+
 	word_t *footerp = header_to_footer(block);
-	*footerp = pack(size, alloc, prev_alloc);
+	*footerp = pack(size, alloc, prev_alloc, prev_mini);
 }
 
 
@@ -575,10 +668,15 @@ static word_t *find_prev_footer(block_t *block)
 /*
  * find_prev: returns the previous block position by checking the previous
  *            block's footer and calculating the start of the previous block
- *            based on its size.
+ *            based on its size. A mini block is always one mini block
+ *            size back, as it has no footer.
  */
 static block_t *find_prev(block_t *block)
 {
+	if(Is_prev_mini(block)) {
+		return (block_t *) ((unsigned char *) block - mini_block_size);
+	}
+
 	word_t *footerp = find_prev_footer(block);
 	size_t size = extract_size(*footerp);
 	return (block_t *) ((unsigned char *) block - size);
@@ -617,7 +715,7 @@ static word_t *header_to_footer(block_t *block)
 static word_t get_payload_size(block_t *block)
 {
 	size_t asize = get_size(block);
-	return asize - dsize;
+	return asize - wsize;
 }
 
 
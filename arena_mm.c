@@ -0,0 +1,983 @@
+/*
+ ******************************************************************************
+ *                                   mm.c                                     *
+ *          64-bit struct-based multi-arena segregated list allocator         *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *             Modified version of one provided to students in malloc lab     *
+ *  This version is thread-safe. The heap is shared by several arenas, each   *
+ *  with its own heap regions, segregated free lists and lock. A thread       *
+ *  allocates from the arena it is assigned to, and a freed block goes back   *
+ *  to the arena that owns its heap page, so threads on different arenas      *
+ *  never wait for each other and no global lock is taken on the fast path.   *
+ *  A block freed by a thread of another arena is pushed on a lock-free       *
+ *  stack of its owner, which coalesces it once it runs short of memory       *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+team_t team = {
+		/* Team name */
+		"ateam",
+		/* First member's full name */
+		"Harry Bovik",
+		/* First member's email address */
+		"bovik@cs.cmu.edu",
+		/* Second member's full name (leave blank if none) */
+		"",
+		/* Second member's email address (leave blank if none) */
+		""
+};
+
+/* Basic constants */
+
+typedef uint64_t word_t;
+
+// Word and header size (bytes)
+static const size_t wsize = sizeof(word_t);
+
+// Double word size (bytes)
+static const size_t dsize = 2 * sizeof(word_t);
+
+/*
+  Minimum useable block size (bytes):
+  two words for header & footer, two words for payload
+*/
+static const size_t min_block_size = 4 * sizeof(word_t);
+
+// Mask to extract allocated bit from header
+static const word_t alloc_mask = 0x1;
+
+/*
+ * Assume: All block sizes are a multiple of 16
+ * and so can use lower 4 bits for flags
+ */
+static const word_t size_mask = ~(word_t) 0xF;
+
+/*
+  The heap is handed to arenas in whole pages of owner_page_size bytes,
+  and the page owner table maps every heap page to its arena. A new
+  region is at least segment_size bytes. An arena whose last region ends
+  at the break grows it in place instead, one page at a time.
+*/
+static const size_t owner_page_size = (1 << 12);
+static const size_t segment_size = (1 << 16);
+
+#define OWNER_PAGES (MAX_HEAP / (1 << 12) + 1)
+
+/*
+  Number of arenas, arenas_per_cpu for every online CPU but at most
+  MAX_ARENAS. A thread is assigned an arena on its first malloc.
+*/
+#define MAX_ARENAS 64
+static const int arenas_per_cpu = 2;
+
+static const int arena_assign = 0; // 0 for round-robin, 1 for moving away from contention
+
+/*
+  Size classes as in the segregated list allocator with exact small bins:
+  one bin per block size up to 2^small_bin_shift bytes, power-of-two
+  classes above that, and the last class collects everything bigger.
+*/
+#define NUM_CLASSES 128
+#define BITMAP_WORDS (NUM_CLASSES / 64)
+static const int small_bin_shift = 10;
+
+/*
+  All blocks have both headers and footers
+
+  Both the header and the footer consist of a single word containing the
+  size and the allocation flag, where size is the total size of the block,
+  including header, (possibly payload), unused space, and footer
+
+  Every region of an arena starts with a prologue footer and ends with
+  an epilogue header, so coalescing never crosses into another region.
+*/
+
+/* Representation of the header and payload of one block in the heap */
+typedef struct block
+{
+	word_t header;
+	/*
+	 * We don't know what the size of the payload will be, so we will
+	 * declare it as a zero-length array.  This allow us to obtain a
+	 * pointer to the start of the payload.
+	 */
+
+	unsigned char payload[0];
+	struct block *previous;
+	struct block *next;
+
+} block_t;
+
+/* One arena, everything in it is protected by its lock */
+typedef struct arena
+{
+	pthread_mutex_t lock;
+
+	// Root of the circular free list of every size class
+	block_t *seg_list[NUM_CLASSES];
+	// Bit i is set when seg_list[i] is non-empty
+	uint64_t class_bitmap[BITMAP_WORDS];
+
+	// Epilogue of the region the arena got last
+	block_t *seg_end;
+
+	/*
+	 * Blocks freed by threads of other arenas, still marked allocated and
+	 * linked through next. Pushed with compare-and-swap without the lock,
+	 * and taken all at once by the arena under its lock.
+	 */
+	block_t *remote_frees;
+
+	int index;
+	size_t heap_size;     // bytes of heap owned
+	size_t segments;      // regions owned
+	size_t contended;     // lock attempts that found the lock taken
+	size_t remote_freed;  // blocks that came back through remote_frees
+
+} arena_t;
+
+
+/* Global variables */
+
+static arena_t arenas[MAX_ARENAS];
+static int arena_count = 1;
+
+// Round-robin counter for assigning arenas to threads
+static unsigned next_arena = 0;
+
+// The arena of the calling thread, NULL until its first malloc
+static __thread arena_t *thread_arena = NULL;
+
+// Serializes growing the heap, which all arenas share
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Index + 1 of the arena owning every heap page, 0 for none
+static uint8_t page_owner[OWNER_PAGES];
+// One past the last page_owner entry written, under sbrk_lock
+static size_t page_owner_top = 0;
+
+/* Function prototypes for internal helper routines */
+
+static block_t *find_fit(arena_t *arena, size_t asize);
+static block_t *search_class(arena_t *arena, int class, size_t asize);
+static block_t *coalesce_block(arena_t *arena, block_t *block);
+static void split_block(arena_t *arena, block_t *block, size_t asize);
+static block_t *extend_arena(arena_t *arena, size_t asize);
+
+static size_t round_up(size_t size, size_t n);
+static word_t pack(size_t size, bool alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc);
+static void write_footer(block_t *block, size_t size, bool alloc);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+static word_t *header_to_footer(block_t *block);
+
+static block_t *find_next(block_t *block);
+static word_t *find_prev_footer(block_t *block);
+static block_t *find_prev(block_t *block);
+void mm_status();
+static word_t get_payload_size(block_t *block);
+
+// functions only for segregated list
+void free_list_status();
+static int find_class(size_t asize);
+static bool is_exact_class(int class);
+static int next_nonempty_class(arena_t *arena, int class);
+static void append_free_list(arena_t *arena, block_t *block);
+static void disconnect_block(arena_t *arena, block_t *block);
+
+// functions only for arenas
+static arena_t *lock_thread_arena(void);
+static arena_t *arena_of(void *bp);
+static void set_page_owner(void *start, size_t size, arena_t *arena);
+static void push_remote_free(arena_t *arena, block_t *block);
+static bool drain_remote_frees(arena_t *arena);
+
+void log_block(block_t *block){
+	bool is_allocate = get_alloc(block);
+	printf("Block address %p,  size = %zd, allocated = %s, ",
+	       block,
+	       get_size(block),
+	       is_allocate ? "Y" : "N");
+
+	if(!is_allocate) {
+		block_t *prev_free = block->previous, *next_free = block->next;
+		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
+	}
+
+	printf("\n");
+}
+
+
+/*
+  Initialize every arena with an empty heap. Must not run while other
+  threads use the allocator.
+ */
+int mm_init()
+{
+	int i;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	arena_count = (cpus > 0) ? cpus * arenas_per_cpu : 1;
+	if(arena_count > MAX_ARENAS) arena_count = MAX_ARENAS;
+
+	for(i = 0; i < MAX_ARENAS; i++) {
+		arena_t *arena = &arenas[i];
+
+		pthread_mutex_init(&arena->lock, NULL);
+		memset(arena->seg_list, 0, sizeof(arena->seg_list));
+		memset(arena->class_bitmap, 0, sizeof(arena->class_bitmap));
+		arena->seg_end = NULL;
+		arena->remote_frees = NULL;
+		arena->index = i;
+		arena->heap_size = 0;
+		arena->segments = 0;
+		arena->contended = 0;
+		arena->remote_freed = 0;
+	}
+
+	memset(page_owner, 0, page_owner_top);
+	page_owner_top = 0;
+
+	// the arena of a thread that moved past arena_count starts over
+	if(thread_arena != NULL && thread_arena->index >= arena_count) {
+		thread_arena = NULL;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate space for payload of size bytes from the arena of the thread
+ */
+void *mm_malloc(size_t size)
+{
+	size_t asize;      // Allocated block size
+	block_t *block = NULL;
+	arena_t *arena;
+
+	if (size == 0) // Ignore spurious request
+		return NULL;
+
+	asize = round_up(size + dsize, dsize);
+	arena = lock_thread_arena();
+
+	// Nothing fits, take back what other threads freed
+	if((block = find_fit(arena, asize)) == NULL && drain_remote_frees(arena)) {
+		block = find_fit(arena, asize);
+	}
+
+	if(block == NULL) {
+		// Still nothing fits, grow the arena
+		if((block = extend_arena(arena, asize)) == NULL) {
+			pthread_mutex_unlock(&arena->lock);
+			return NULL;
+		}
+	}
+
+	disconnect_block(arena, block);
+
+	// Mark block as allocated
+	size_t block_size = get_size(block);
+	write_header(block, block_size, true);
+	write_footer(block, block_size, true);
+
+	// Try to split the block if too large
+	split_block(arena, block, asize);
+
+	pthread_mutex_unlock(&arena->lock);
+	return header_to_payload(block);
+}
+
+/*
+ * Free allocated block into the arena that owns it. A block of another
+ * arena than the thread's own is only queued there, without its lock.
+ */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	arena_t *arena = arena_of(bp);
+	block_t *block = payload_to_header(bp);
+
+	// The block should be marked as allocated
+	if (!get_alloc(block)) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	if (arena != thread_arena) {
+		push_remote_free(arena, block);
+		return;
+	}
+
+	pthread_mutex_lock(&arena->lock);
+
+	// Mark the block as free
+	size_t size = get_size(block);
+	write_header(block, size, false);
+	write_footer(block, size, false);
+
+	// Try to coalesce the block with its neighbors
+	coalesce_block(arena, block);
+
+	pthread_mutex_unlock(&arena->lock);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+	size_t copysize;
+	void *newptr;
+
+	// If size == 0, then free block and return NULL
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+	{
+		return mm_malloc(size);
+	}
+
+	// Otherwise, proceed with reallocation
+	newptr = mm_malloc(size);
+	// If malloc fails, the original block is left untouched
+	if (!newptr)
+	{
+		return NULL;
+	}
+
+	// Copy the old data
+	copysize = mm_usable_size(ptr); // gets size of old payload
+	if(size < copysize)
+	{
+		copysize = size;
+	}
+	memcpy(newptr, ptr, copysize);
+
+	// Free the old block
+	mm_free(ptr);
+
+	return newptr;
+}
+
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
+/* Print the usage of every arena that owns any heap */
+void mm_status() {
+	int i;
+
+	printf("The status of %d arenas\n", arena_count);
+	printf("*******************************\n");
+	for(i = 0; i < arena_count; i++) {
+		arena_t *arena = &arenas[i];
+		if(arena->segments == 0) continue;
+
+		printf("Arena %d: heap = %zu bytes in %zu regions, contended = %zu, remote frees = %zu\n",
+		       i, arena->heap_size, arena->segments, arena->contended,
+		       arena->remote_freed);
+	}
+	printf("*******************************\n");
+}
+
+/* Print every non-empty size class of every arena */
+void free_list_status() {
+	int i, class;
+
+	for(i = 0; i < arena_count; i++) {
+		for(class = 0; class < NUM_CLASSES; class++) {
+			block_t *block = arenas[i].seg_list[class];
+			if(block == NULL) continue;
+
+			printf("Arena %d size class %d\n", i, class);
+			printf("-------------------------------\n");
+			do{
+				log_block(block);
+				block = block->next;
+			}while(block != arenas[i].seg_list[class]);
+			printf("-------------------------------\n");
+		}
+	}
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+
+/*
+ * Attempt to coalesce block with its predecessor and successor,
+ * then put the result into its size class. Returns the coalesced block.
+ */
+static block_t *coalesce_block(arena_t *arena, block_t *block)
+{
+	size_t size = get_size(block);
+
+	block_t *block_next = find_next(block);
+	block_t *block_prev = find_prev(block);
+
+	bool prev_alloc = extract_alloc(*find_prev_footer(block));
+	bool next_alloc = get_alloc(block_next);
+
+	if (prev_alloc && next_alloc)              // Case 1
+	{
+		//Nothing to do
+	}
+
+	else if (prev_alloc && !next_alloc)        // Case 2
+	{
+		disconnect_block(arena, block_next);
+
+		size += get_size(block_next);
+		write_header(block, size, false);
+		write_footer(block, size, false);
+	}
+
+	else if (!prev_alloc && next_alloc)        // Case 3
+	{
+		disconnect_block(arena, block_prev);
+
+		size += get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	else                                        // Case 4
+	{
+		disconnect_block(arena, block_prev);
+		disconnect_block(arena, block_next);
+
+		size += get_size(block_next) + get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	append_free_list(arena, block);
+	return block;
+}
+
+
+/*
+ * See if new block can be split one to satisfy allocation
+ * and one to keep free. The block must already be off its free list.
+ */
+static void split_block(arena_t *arena, block_t *block, size_t asize)
+{
+	size_t block_size = get_size(block);
+
+	if ((block_size - asize) >= min_block_size)
+	{
+		write_header(block, asize, true);
+		write_footer(block, asize, true);
+
+		block_t *block_next = find_next(block);
+		write_header(block_next, block_size - asize, false);
+		write_footer(block_next, block_size - asize, false);
+
+		// The block after the remainder is allocated, no need to coalesce
+		append_free_list(arena, block_next);
+	}
+}
+
+
+/*
+ * Find a free block of size at least asize, looking only at the class
+ * of the request and the non-empty classes above it
+ */
+static block_t *find_fit(arena_t *arena, size_t asize) {
+	int class;
+	block_t *block;
+
+	for(class = next_nonempty_class(arena, find_class(asize));
+	    class >= 0;
+	    class = next_nonempty_class(arena, class + 1)) {
+		if((block = search_class(arena, class, asize)) != NULL) {
+			return block;
+		}
+	}
+
+	return NULL; // no fit found
+}
+
+/*
+ * Best fit inside one size class
+ */
+static block_t *search_class(arena_t *arena, int class, size_t asize) {
+	block_t *root = arena->seg_list[class];
+	block_t *block = root;
+	block_t *best_block = NULL;
+
+	if(root == NULL) return NULL;
+
+	// every block of an exact bin has the same size
+	if(is_exact_class(class)) return (asize <= get_size(root)) ? root : NULL;
+
+	do{
+		if (asize <= get_size(block)) {
+			if(best_block == NULL || (get_size(best_block) > get_size(block))){
+				best_block = block;
+				if(get_size(block) == asize) break;
+			}
+		}
+
+		block = block->next;
+
+	}while(block != root);
+
+	return best_block;
+}
+
+/*
+ * Give the arena a free block of at least asize bytes and return it,
+ * already on its free list. The last region of the arena is grown in
+ * place while it ends at the break, otherwise the arena gets a new
+ * region of its own.
+ */
+static block_t *extend_arena(arena_t *arena, size_t asize)
+{
+	void *bp;
+	size_t size;
+	block_t *block;
+
+	pthread_mutex_lock(&sbrk_lock);
+
+	bool in_place = arena->seg_end != NULL &&
+	                (unsigned char *) arena->seg_end + wsize == (unsigned char *) mem_sbrk(0);
+
+	if(in_place) {
+		size = round_up(asize, owner_page_size);
+	}else{
+		size = round_up(asize + dsize, owner_page_size);
+		if(size < segment_size) size = segment_size;
+	}
+
+	// On huge pages, grow up to the next huge page boundary
+	if(mem_hugepagesize() != 0) {
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
+	}
+
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+	{
+		pthread_mutex_unlock(&sbrk_lock);
+		return NULL;
+	}
+
+	set_page_owner(bp, size, arena);
+	pthread_mutex_unlock(&sbrk_lock);
+
+	arena->heap_size += size;
+
+	if(in_place) {
+		// The old epilogue becomes the header of the new free block
+		block = arena->seg_end;
+		write_header(block, size, false);
+		write_footer(block, size, false);
+	}else{
+		// Prologue footer, one free block, epilogue header
+		*(word_t *) bp = pack(0, true);
+		block = (block_t *) ((unsigned char *) bp + wsize);
+		write_header(block, size - dsize, false);
+		write_footer(block, size - dsize, false);
+		arena->segments++;
+	}
+
+	// Create new epilogue header
+	arena->seg_end = find_next(block);
+	write_header(arena->seg_end, 0, true);
+
+	// Coalesce in case the previous block was free
+	return coalesce_block(arena, block);
+}
+
+/*
+ *****************************************************************************
+ * The functions below deal with arenas: which arena a thread allocates    *
+ * from, and which arena owns a block.                                       *
+ *****************************************************************************
+ */
+
+
+/*
+ * lock_thread_arena: returns the arena of the calling thread, locked. A
+ *                    thread without one is given the next arena in turn.
+ *                    When moving away from contention, a thread that
+ *                    finds its arena busy takes the first idle one instead.
+ */
+static arena_t *lock_thread_arena(void)
+{
+	arena_t *arena = thread_arena;
+	int i;
+
+	if(arena == NULL) {
+		unsigned turn = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+		arena = thread_arena = &arenas[turn % arena_count];
+	}
+
+	if(pthread_mutex_trylock(&arena->lock) == 0) {
+		return arena;
+	}
+
+	__atomic_fetch_add(&arena->contended, 1, __ATOMIC_RELAXED);
+
+	if(arena_assign == 1) {
+		for(i = 1; i < arena_count; i++) {
+			arena_t *other = &arenas[(arena->index + i) % arena_count];
+			if(pthread_mutex_trylock(&other->lock) == 0) {
+				thread_arena = other;
+				return other;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&arena->lock);
+	return arena;
+}
+
+/*
+ * arena_of: returns the arena owning the heap page of bp. The entry was
+ *           written before the block was handed out and does not change
+ *           while the block is allocated, so no lock is needed.
+ */
+static arena_t *arena_of(void *bp)
+{
+	size_t page = ((unsigned char *) bp - (unsigned char *) mem_heap_lo()) / owner_page_size;
+	return &arenas[page_owner[page] - 1];
+}
+
+static void set_page_owner(void *start, size_t size, arena_t *arena)
+{
+	size_t page = ((unsigned char *) start - (unsigned char *) mem_heap_lo()) / owner_page_size;
+	size_t last = page + size / owner_page_size;
+
+	for(; page < last; page++) {
+		page_owner[page] = arena->index + 1;
+	}
+	if(last > page_owner_top) page_owner_top = last;
+}
+
+/*
+ * push_remote_free: pushes a block freed by a thread of another arena on
+ *                   the remote free stack of its owner. Many threads may
+ *                   push at once, only the owner under its lock pops, and
+ *                   it always takes the whole stack, so there is no ABA.
+ */
+static void push_remote_free(arena_t *arena, block_t *block)
+{
+	block_t *head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+
+	do{
+		block->next = head;
+	}while(!__atomic_compare_exchange_n(&arena->remote_frees, &head, block, true,
+	                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * drain_remote_frees: takes the whole remote free stack of a locked arena
+ *                     and frees and coalesces every block on it. Returns
+ *                     false if the stack was empty.
+ */
+static bool drain_remote_frees(arena_t *arena)
+{
+	block_t *block = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+
+	if(block == NULL) return false;
+
+	while(block != NULL) {
+		block_t *next = block->next;
+		size_t size = get_size(block);
+
+		write_header(block, size, false);
+		write_footer(block, size, false);
+		coalesce_block(arena, block);
+		arena->remote_freed++;
+
+		block = next;
+	}
+
+	return true;
+}
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+	return n * ((size + (n-1)) / n);
+}
+
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ */
+static word_t pack(size_t size, bool alloc)
+{
+	return alloc ? (size | alloc_mask) : size;
+}
+
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+	return (word & size_mask);
+}
+
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the heap is 16-byte aligned).
+ */
+static size_t get_size(block_t *block)
+{
+	return extract_size(block->header);
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+	return (bool) (word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+	return extract_alloc(block->header);
+}
+
+
+/*
+ * write_header: given a block and its size and allocation status,
+ *               writes an appropriate value to the block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc)
+{
+	block->header = pack(size, alloc);
+}
+
+
+/*
+ * write_footer: given a block and its size and allocation status,
+ *               writes an appropriate value to the block footer by first
+ *               computing the position of the footer.
+ */
+static void write_footer(block_t *block, size_t size, bool alloc)
+{
+	word_t *footerp = header_to_footer(block);
+	*footerp = pack(size, alloc);
+}
+
+
+/*
+ * find_next: returns the next consecutive block on the heap by adding the
+ *            size of the block.
+ */
+static block_t *find_next(block_t *block)
+{
+	return (block_t *) ((unsigned char *) block + get_size(block));
+}
+
+
+/*
+ * find_prev_footer: returns the footer of the previous block.
+ */
+static word_t *find_prev_footer(block_t *block)
+{
+	// Compute previous footer position as one word before the header
+	return &(block->header) - 1;
+}
+
+
+/*
+ * find_prev: returns the previous block position by checking the previous
+ *            block's footer and calculating the start of the previous block
+ *            based on its size.
+ */
+static block_t *find_prev(block_t *block)
+{
+	word_t *footerp = find_prev_footer(block);
+	size_t size = extract_size(*footerp);
+	return (block_t *) ((unsigned char *) block - size);
+}
+
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+	return (void *) (block->payload);
+}
+
+
+/*
+ * header_to_footer: given a block pointer, returns a pointer to the
+ *                   corresponding footer.
+ */
+static word_t *header_to_footer(block_t *block)
+{
+	return (word_t *) (block->payload + get_size(block) - dsize);
+}
+
+static word_t get_payload_size(block_t *block)
+{
+	size_t asize = get_size(block);
+	return asize - dsize;
+}
+
+/*
+ * find_class: maps a block size to its size class, using
+ *             count-leading-zeros to find the power-of-two class.
+ */
+static int find_class(size_t asize)
+{
+	int class, exact_bins, log_size;
+
+	if(asize <= min_block_size) return 0;
+
+	exact_bins = ((1 << small_bin_shift) - min_block_size) / dsize + 1;
+	if(asize <= ((size_t) 1 << small_bin_shift)) {
+		return (asize - min_block_size) / dsize;
+	}
+
+	// smallest k with asize <= 2^k
+	log_size = 64 - __builtin_clzll((unsigned long long) (asize - 1));
+	class = exact_bins + log_size - small_bin_shift - 1;
+
+	return (class < NUM_CLASSES - 1) ? class : NUM_CLASSES - 1;
+}
+
+/*
+ * is_exact_class: returns true when the class only holds blocks of a single size
+ */
+static bool is_exact_class(int class)
+{
+	return class < ((1 << small_bin_shift) - (int) min_block_size) / (int) dsize + 1;
+}
+
+/*
+ * next_nonempty_class: returns the first non-empty class of the arena that
+ *                      is not below class, or -1 if there is none
+ */
+static int next_nonempty_class(arena_t *arena, int class)
+{
+	int word;
+	uint64_t bits;
+
+	if(class >= NUM_CLASSES) return -1;
+
+	word = class / 64;
+	bits = arena->class_bitmap[word] & (~(uint64_t) 0 << (class % 64));
+
+	while(bits == 0) {
+		if(++word == BITMAP_WORDS) return -1;
+		bits = arena->class_bitmap[word];
+	}
+
+	return word * 64 + __builtin_ctzll(bits);
+}
+
+// put the block at the front of the circular list of its size class
+static void append_free_list(arena_t *arena, block_t *block) {
+	if(get_alloc(block)) {
+		fprintf(stderr, "Cannot add an allocated ptr to the free list\n");
+		exit(-1);
+	}
+
+	int class = find_class(get_size(block));
+	block_t *root = arena->seg_list[class];
+
+	arena->seg_list[class] = block;
+
+	// empty class, the block becomes its own circle
+	if(root == NULL) {
+		block->previous = block;
+		block->next = block;
+		arena->class_bitmap[class / 64] |= (uint64_t) 1 << (class % 64);
+		return;
+	}
+
+	// connect the block to the prev of the root
+	block->next = root;
+	block->previous = root->previous;
+	root->previous->next = block;
+	root->previous = block;
+}
+
+// take the block out of the circular list of its size class
+static void disconnect_block(arena_t *arena, block_t *block) {
+	int class = find_class(get_size(block));
+
+	if(block->next == block) {
+		arena->seg_list[class] = NULL;
+		arena->class_bitmap[class / 64] &= ~((uint64_t) 1 << (class % 64));
+		return;
+	}
+
+	block_t *cur_prev = block->previous, *cur_next = block->next;
+	cur_prev->next = cur_next;
+	cur_next->previous = cur_prev;
+
+	if(block == arena->seg_list[class]) arena->seg_list[class] = cur_next;
+}
@@ -45,15 +45,23 @@ static const size_t wsize = sizeof(word_t);
 static const size_t dsize = 2 * sizeof(word_t);
 
 /*
-  Minimum useable block size (bytes):
-  two words for header & footer, two words for payload
+  Minimum useable block size (bytes) is the mini block size:
+  one word for header, one word for payload. Any bigger free block holds
+  a header, a footer and two list pointers. A free mini block has no room
+  for those, so it lives on its own single-linked list and its successor
+  finds it through the prev_mini bit instead of a footer.
 */
-static const size_t min_block_size = 4 * sizeof(word_t);
+static const size_t mini_block_size = 2 * sizeof(word_t);
 
 // Mask to extract allocated bit from header
 static const word_t alloc_mask = 0x1;
 
-//static const word_t prev_alloc_mask = 0b10;
+static const word_t prev_alloc_mask = 0b10;
+
+static const word_t prev_mini_mask = 0b100;
+
+// Set in the header of a free block that waits in the unsorted bin
+static const word_t unsorted_mask = 0b1000;
 
 /*
  * Assume: All block sizes are a multiple of 16
@@ -64,11 +72,44 @@ static const word_t size_mask = ~(word_t) 0xF;
 static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
 
 /*
-  All blocks have both headers and footers
+  Free blocks of at least tree_threshold bytes are not kept on the circular
+  free list but in an AVL tree ordered by size. Blocks of equal size hang
+  off the tree node as a chain, so every tree node has a distinct size.
+*/
+static const size_t tree_threshold = 512;
+
+/*
+  With add_type 3 the free list is kept in address order, and a skip list
+  over the same blocks finds the insertion point in O(log n). Level 0 of
+  the skip list is the free list itself. The upper levels of a block's
+  tower live in its payload after the list links, so a block is never
+  taller than its free space allows. A block of small_block_size bytes
+  has no room for even one upper level, and a run of them would turn the
+  walk on level 0 linear, so in this mode they are kept on a circular
+  list of their own instead, like the mini blocks.
+*/
+#define SKIP_LEVELS 16
+static const size_t small_block_size = 2 * dsize;
+
+/*
+  Freed and coalesced blocks go to the unsorted bin first, a circular list
+  where insertion is O(1) whatever add_type asks for. The next malloc
+  takes an exact fit from it at once, and every other block it passes on
+  the way is moved to its proper place on the free list or in the tree.
+  Mini blocks are cheap to place and skip the unsorted bin.
+*/
+static const bool use_unsorted_bin = true;
+
+/*
+  Only free blocks have footers, allocated blocks have just a header.
+  Mini blocks never have a footer.
 
   Both the header and the footer consist of a single word containing the
-  size and the allocation flag, where size is the total size of the block,
-  including header, (possibly payload), unused space, and footer
+  size, the allocation flag, the allocation flag of the previous block and
+  whether the previous block is a mini block, where size is the total size
+  of the block, including header, (possibly payload), unused space, and
+  footer. Coalescing reads the previous block's status from the header,
+  and only follows its footer when it is free and not a mini block.
 */
 
 /* Representation of the header and payload of one block in the heap */
@@ -82,9 +123,33 @@ typedef struct block
 	 */
 
 	unsigned char payload[0];
-	struct block *previous;
+	/*
+	 * A free mini block only has room for one link, so the mini list
+	 * is single-linked through mini_next, which shares the word with
+	 * previous.
+	 */
+	union {
+		struct block *previous;
+		struct block *mini_next;
+	};
 	struct block *next;
 
+	union {
+		/*
+		 * Only used by blocks in the size tree. For a tree node, next is the
+		 * head of its chain of equal-size blocks and height is at least 1.
+		 * Chained blocks have height 0 and use previous/next as chain links.
+		 */
+		struct {
+			struct block *left;
+			struct block *right;
+			word_t height;
+		};
+
+		// Only used by blocks of the address-ordered list, skip[i] links level i + 1
+		struct block *skip[0];
+	};
+
 } block_t;
 
 
@@ -98,28 +163,54 @@ static block_t *heap_end = NULL;
 static block_t *free_list_root = NULL;
 static int free_list_len = 0;
 
+// Single-linked LIFO list of free mini blocks
+static block_t *mini_list_root = NULL;
+static int mini_list_len = 0;
+
+// Circular list of free small blocks, only used with add_type 3
+static block_t *small_list_root = NULL;
+static int small_list_len = 0;
+
+// Root of the size tree of large free blocks
+static block_t *tree_root = NULL;
+static int tree_len = 0;
+
+// Circular list of free blocks not sorted into place yet
+static block_t *unsorted_root = NULL;
+static int unsorted_len = 0;
+
 static block_t *next_fit_ptr = NULL;
 
+// Heads of the skip list levels above the free list, skip_head[0] is unused
+static block_t *skip_head[SKIP_LEVELS];
+static uint32_t skip_seed = 1;
+
 /* Function prototypes for internal helper routines */
 
-static block_t * (*find_fit)(size_t asize);
+static block_t *find_fit(size_t asize);
+static block_t * (*find_list_fit)(size_t asize);
 static block_t *first_fit(size_t asize);
 static block_t *next_fit(size_t asize);
 static block_t *best_fit(size_t asize);
-static void coalesce_block(block_t *block);
+static block_t *coalesce_block(block_t *block);
 static void split_block(block_t *block, size_t asize);
 
 static size_t round_up(size_t size, size_t n);
-static word_t pack(size_t size, bool alloc);
+static word_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini);
 
 static size_t extract_size(word_t header);
 static size_t get_size(block_t *block);
 
 static bool extract_alloc(word_t header);
 static bool get_alloc(block_t *block);
+static bool Is_prev_alloc(block_t *block);
+static bool extract_prev_alloc(word_t word);
+static void set_prev_alloc(block_t *block, bool prev_alloc);
+static bool Is_prev_mini(block_t *block);
+static void set_prev_mini(block_t *block, bool prev_mini);
 
-static void write_header(block_t *block, size_t size, bool alloc);
-static void write_footer(block_t *block, size_t size, bool alloc);
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini);
+static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini);
 
 static block_t *payload_to_header(void *bp);
 static void *header_to_payload(block_t *block);
@@ -140,15 +231,52 @@ static void append_free_list_LIFO(block_t* block);
 static void append_free_list_by_sequence(block_t* block);
 static void append_free_list(block_t* block, const int type); // 1 for LIFO, 2 for FIFO, 3 for ordered
 static void disconnect_block(block_t *block);
+static void append_mini_list(block_t *block);
+static void disconnect_mini_block(block_t *block);
+static bool is_small_listed(block_t *block);
+static void append_small_list(block_t *block);
+static void disconnect_small_block(block_t *block);
+
+// functions only for the unsorted bin
+static bool Is_unsorted(block_t *block);
+static void append_unsorted(block_t *block);
+static void disconnect_unsorted(block_t *block);
+static block_t *unsorted_fit(size_t asize);
+
+// functions only for the address-ordered skip list
+static block_t **skip_next(block_t *block, int level);
+static block_t *skip_find_prev(block_t *block, block_t **update);
+static int skip_height(block_t *block);
+static block_t *skip_insert(block_t *block);
+static void skip_remove(block_t *block);
+
+// functions only for the size tree
+static block_t *tree_best_fit(size_t asize);
+static block_t *tree_insert(block_t *node, block_t *block);
+static block_t *tree_remove(block_t *node, block_t *block);
+static block_t *tree_remove_min(block_t *node, block_t **min);
+static block_t *tree_balance(block_t *node);
+static block_t *tree_rotate_left(block_t *node);
+static block_t *tree_rotate_right(block_t *node);
+static word_t tree_height(block_t *node);
+static void tree_update_height(block_t *node);
+static bool find_block_in_tree(block_t *target);
+
+static const int fit_type = 2; // 0 for first fit, 1 for next fit, 2 for best fit
+static const int add_type = 2; // 1 for LIFO, 2 for FIFO, 3 for ordered
 
 void log_block(block_t *block){
 	bool is_allocate = get_alloc(block);
-	printf("Block address %p,  size = %zd, allocated = %s, ",
+	printf("Block address %p,  size = %zd, allocated = %s, prev_allocated = %s, prev_mini = %s, ",
 	       block,
 	       get_size(block),
-	       is_allocate ? "Y" : "N");
+	       is_allocate ? "Y" : "N",
+	       Is_prev_alloc(block) ? "Y" : "N",
+	       Is_prev_mini(block) ? "Y" : "N");
 
-	if(!is_allocate) {
+	if(!is_allocate && get_size(block) == mini_block_size) {
+		printf("next_mini_block = %p", block->mini_next);
+	}else if(!is_allocate) {
 		block_t *prev_free = block->previous, *next_free = block->next;
 		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
 	}
@@ -169,6 +297,42 @@ bool find_block_in_free_list(block_t *target) {
 	return false;
 }
 
+bool find_block_in_mini_list(block_t *target) {
+	block_t *temp;
+
+	for(temp = mini_list_root; temp != NULL; temp = temp->mini_next) {
+		if(target == temp) return true;
+	}
+
+	return false;
+}
+
+bool find_block_in_small_list(block_t *target) {
+	block_t *temp = small_list_root;
+
+	if(temp == NULL) return false;
+
+	do{
+		if(target == temp) return true;
+		temp = temp->next;
+	}while(temp != small_list_root);
+
+	return false;
+}
+
+bool find_block_in_unsorted(block_t *target) {
+	block_t *temp = unsorted_root;
+
+	if(temp == NULL) return false;
+
+	do{
+		if(target == temp) return true;
+		temp = temp->next;
+	}while(temp != unsorted_root);
+
+	return false;
+}
+
 bool debug_free_list() {
 	block_t *temp = heap_start;
 	int count = 0;
@@ -176,18 +340,35 @@ bool debug_free_list() {
 	while(temp != heap_end) {
 		if(!get_alloc(temp)) {
 			count ++;
-			if(!find_block_in_free_list(temp)) return false;
+			if(Is_unsorted(temp)) {
+				if(!find_block_in_unsorted(temp)) return false;
+			}
+			else if(get_size(temp) == mini_block_size) {
+				if(!find_block_in_mini_list(temp)) return false;
+			}
+			else if(is_small_listed(temp)) {
+				if(!find_block_in_small_list(temp)) return false;
+			}
+			else if(get_size(temp) >= tree_threshold) {
+				if(!find_block_in_tree(temp)) return false;
+			}
+			else if(!find_block_in_free_list(temp)) return false;
 		}
-		else if(get_size(temp) >= 5 * chunksize) return false;
 
 		temp = find_next(temp);
 	}
 
-	return (count == free_list_len);
+	// the address-ordered list must be sorted from the root on
+	if(add_type == 3 && free_list_root != NULL) {
+		for(temp = free_list_root; temp->next != free_list_root; temp = temp->next) {
+			if(temp->next < temp) return false;
+		}
+	}
+
+	return (count == free_list_len + tree_len + mini_list_len + small_list_len +
+	        unsorted_len);
 }
 
-static const int fit_type = 2; // 0 for first fit, 1 for next fit, 2 for best fit
-static const int add_type = 2; // 1 for LIFO, 2 for FIFO, 3 for ordered
 
 
 /*
@@ -201,11 +382,22 @@ int mm_init()
 		return -1;
 	}
 
-	start[0] = pack(0, true); // Prologue footer
-	start[1] = pack(0, true); // Epilogue header
+	start[0] = pack(0, true, true, false); // Prologue footer
+	start[1] = pack(0, true, true, false); // Epilogue header
 
 	free_list_root = NULL;
 	free_list_len = 0;
+	mini_list_root = NULL;
+	mini_list_len = 0;
+	small_list_root = NULL;
+	small_list_len = 0;
+	unsorted_root = NULL;
+	unsorted_len = 0;
+	memset(skip_head, 0, sizeof(skip_head));
+	skip_seed = 1;
+	tree_root = NULL;
+	tree_len = 0;
+	next_fit_ptr = NULL;
 
 	// Extend the empty heap with a free block of chunksize bytes
 	if ((heap_start = extend_heap(chunksize)) == NULL)
@@ -215,12 +407,11 @@ int mm_init()
 
 
 	if(fit_type == 0) {
-		find_fit = first_fit;
+		find_list_fit = first_fit;
 	}else if(fit_type == 1) {
-		find_fit = next_fit;
-		next_fit_ptr = NULL;
+		find_list_fit = next_fit;
 	}else if(fit_type == 2){
-		find_fit = best_fit;
+		find_list_fit = best_fit;
 	}
 
 	return 0;
@@ -238,18 +429,27 @@ void *mm_malloc(size_t size)
 	if (size == 0) // Ignore spurious request
 		return bp;
 
-	asize = round_up(size + dsize, dsize);
-	while((block = find_fit(asize)) == NULL) {
-		extend_heap(chunksize);
+	// only one header but no footer for allocated block,
+	// payloads of up to one word fit a mini block
+	asize = round_up(size + wsize, dsize);
+
+	if((block = find_fit(asize)) == NULL) {
+		// Nothing fits, grow the heap
+		size_t extend_size = asize > chunksize ? asize : chunksize;
+		if((block = extend_heap(extend_size)) == NULL) {
+			return NULL;
+		}
 	}
 
-	// Mark block as allocated
+	disconnect_block(block);
+
+	// Mark block as allocated, no need to write footer
 	size_t block_size = get_size(block);
-	write_header(block, block_size, true);
-	write_footer(block, block_size, true);
+	write_header(block, block_size, true, Is_prev_alloc(block), Is_prev_mini(block));
 
 	// Try to split the block if too large
 	split_block(block, asize);
+	set_prev_alloc(find_next(block), true);
 	bp = header_to_payload(block);
 
 	return bp;
@@ -271,8 +471,10 @@ void mm_free(void *bp)
 	}
 
 	// Mark the block as free
-	write_header(block, size, false);
-	write_footer(block, size, false);
+	bool is_prev_allocate = Is_prev_alloc(block);
+	bool is_prev_mini = Is_prev_mini(block);
+	write_header(block, size, false, is_prev_allocate, is_prev_mini);
+	write_footer(block, size, false, is_prev_allocate, is_prev_mini);
 
 	// Try to coalesce the block with its neighbors
 	coalesce_block(block);
@@ -287,18 +489,18 @@ void *mm_realloc(void *ptr, size_t size) {
 	// If size == 0, then free block and return NULL
 	if (size == 0)
 	{
-		free(ptr);
+		mm_free(ptr);
 		return NULL;
 	}
 
 	// If ptr is NULL, then equivalent to malloc
 	if (ptr == NULL)
 	{
-		return malloc(size);
+		return mm_malloc(size);
 	}
 
 	// Otherwise, proceed with reallocation
-	newptr = malloc(size);
+	newptr = mm_malloc(size);
 	// If malloc fails, the original block is left untouched
 	if (!newptr)
 	{
@@ -319,6 +521,15 @@ void *mm_realloc(void *ptr, size_t size) {
 	return newptr;
 }
 
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
 /* Print status of every block in heap */
 void mm_status() {
 	block_t *block = heap_start;
@@ -350,18 +561,27 @@ void free_list_status() {
 
 
 /*
- * Attempt to coalesce block with its predecessor and successor
+ * Attempt to coalesce block with its predecessor and successor,
+ * then put the result on the free list. Returns the coalesced block.
+ *
+ * A free block never follows another free block, so the coalesced
+ * block always has an allocated predecessor, and the block after it
+ * learns that its predecessor is now free and whether it is a mini block.
  */
-static void coalesce_block(block_t *block)
+static block_t *coalesce_block(block_t *block)
 {
 	size_t size = get_size(block);
 
 	block_t *block_next = find_next(block);
-	block_t *block_prev = find_prev(block);
+	block_t *block_prev = NULL;
 
-	bool prev_alloc = extract_alloc(*find_prev_footer(block));
+	bool prev_alloc = Is_prev_alloc(block);
 	bool next_alloc = get_alloc(block_next);
 
+	// the previous block can only be located when it is free
+	if (!prev_alloc)
+		block_prev = find_prev(block);
+
 	if (prev_alloc && next_alloc)              // Case 1
 	{
 		//Nothing to do
@@ -372,8 +592,9 @@ static void coalesce_block(block_t *block)
 		disconnect_block(block_next);
 
 		size += get_size(block_next);
-		write_header(block, size, false);
-		write_footer(block, size, false);
+		bool is_prev_mini = Is_prev_mini(block);
+		write_header(block, size, false, true, is_prev_mini);
+		write_footer(block, size, false, true, is_prev_mini);
 	}
 
 	else if (!prev_alloc && next_alloc)        // Case 3
@@ -381,54 +602,97 @@ static void coalesce_block(block_t *block)
 		disconnect_block(block_prev);
 
 		size += get_size(block_prev);
-		write_header(block_prev, size, false);
-		write_footer(block_prev, size, false);
+		bool is_prev_mini = Is_prev_mini(block_prev);
+		write_header(block_prev, size, false, true, is_prev_mini);
+		write_footer(block_prev, size, false, true, is_prev_mini);
 		block = block_prev;
 	}
 
 	else                                        // Case 4
 	{
 		disconnect_block(block_prev);
-		disconnect_block(block_prev);
+		disconnect_block(block_next);
 
 		size += get_size(block_next) + get_size(block_prev);
-		write_header(block_prev, size, false);
-		write_footer(block_prev, size, false);
+		bool is_prev_mini = Is_prev_mini(block_prev);
+		write_header(block_prev, size, false, true, is_prev_mini);
+		write_footer(block_prev, size, false, true, is_prev_mini);
 		block = block_prev;
 	}
 
+	set_prev_alloc(find_next(block), false);
+	set_prev_mini(find_next(block), size == mini_block_size);
+
 
 	if(!next_alloc && next_fit_ptr == block_next) {
 		next_fit_ptr = block;
 	}
 
-	append_free_list(block, add_type);
+	if(use_unsorted_bin && size != mini_block_size) {
+		append_unsorted(block);
+	}else{
+		append_free_list(block, add_type);
+	}
+	return block;
 }
 
 
 /*
  * See if new block can be split one to satisfy allocation
- * and one to keep free
+ * and one to keep free. The block must already be off the free list,
+ * since the free list position depends on the size.
  */
 static void split_block(block_t *block, size_t asize)
 {
 	size_t block_size = get_size(block);
 
-	if ((block_size - asize) >= min_block_size)
+	if ((block_size - asize) >= mini_block_size)
 	{
-		write_header(block, asize, true);
-		write_footer(block, asize, true);
+		write_header(block, asize, true, Is_prev_alloc(block), Is_prev_mini(block));
 
 		block_t *block_next = find_next(block);
-		write_header(block_next, block_size - asize, false);
-		write_footer(block_next, block_size - asize, false);
+		bool is_prev_mini = (asize == mini_block_size);
+		write_header(block_next, block_size - asize, false, true, is_prev_mini);
+		write_footer(block_next, block_size - asize, false, true, is_prev_mini);
 
-		disconnect_block(block);
 		coalesce_block(block_next);
 	}
-	else{
-		disconnect_block(block);
+}
+
+
+/*
+ * Find a free block of size at least asize. An exact fit waiting in the
+ * unsorted bin wins, and the blocks passed on the way are sorted into
+ * place. Mini requests take the head of the mini list, which is always
+ * an exact fit. Small requests use the discipline selected by fit_type
+ * on the free list first; anything the list cannot serve is the best fit
+ * of the size tree, whose blocks are all bigger than every block of the
+ * list.
+ */
+static block_t *find_fit(size_t asize) {
+	block_t *block = NULL;
+
+	if(use_unsorted_bin && (block = unsorted_fit(asize)) != NULL) {
+		return block;
+	}
+
+	if(asize == mini_block_size && mini_list_root != NULL) {
+		return mini_list_root;
+	}
+
+	if(asize <= small_block_size && small_list_root != NULL) {
+		return small_list_root;
+	}
+
+	if(asize < tree_threshold && free_list_root != NULL) {
+		block = find_list_fit(asize);
+	}
+
+	if(block == NULL) {
+		block = tree_best_fit(asize);
 	}
+
+	return block;
 }
 
 
@@ -439,6 +703,8 @@ static void split_block(block_t *block, size_t asize)
 static block_t *first_fit(size_t asize) {
 	block_t *block = free_list_root;
 
+	if(block == NULL) return NULL;
+
 	do{
 
 		if ((asize <= get_size(block))) return block;
@@ -456,6 +722,8 @@ static block_t *next_fit(size_t asize) {
 		next_fit_ptr = free_list_root;
 	}
 
+	if(next_fit_ptr == NULL) return NULL;
+
 	block_t *piviot = next_fit_ptr;
 
 	do{
@@ -475,6 +743,8 @@ static block_t *best_fit(size_t asize) {
 	block_t *block = free_list_root;
 	block_t *best_block = NULL;
 
+	if(block == NULL) return NULL;
+
 	do{
 		if (!(get_alloc(block)) && (asize <= get_size(block))) {
 			if(best_block == NULL || (get_size(best_block) > get_size(block))){
@@ -495,24 +765,29 @@ static block_t *extend_heap(size_t size)
 
 	// Allocate an even number of words to maintain alignment
 	size = round_up(size, dsize);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
 	if ((bp = mem_sbrk(size)) == (void *)-1)
 	{
 		return NULL;
 	}
 
-	// Initialize free block header/footer
+	// Initialize free block header/footer, the old epilogue knows
+	// whether the last block is allocated
 	block_t *block = payload_to_header(bp);
-	write_header(block, size, false);
-	write_footer(block, size, false);
+	bool is_prev_allocate = Is_prev_alloc(block);
+	bool is_prev_mini = Is_prev_mini(block);
+	write_header(block, size, false, is_prev_allocate, is_prev_mini);
+	write_footer(block, size, false, is_prev_allocate, is_prev_mini);
 	// Create new epilogue header
 	block_t *block_next = find_next(block);
-	write_header(block_next, 0, true);
+	write_header(block_next, 0, true, false, false);
 	heap_end = block_next;
 
 
 	// Coalesce in case the previous block was free
-	coalesce_block(block);
-	return block;
+	return coalesce_block(block);
 }
 
 /*
@@ -535,10 +810,26 @@ static size_t round_up(size_t size, size_t n)
 /*
  * pack: returns a header reflecting a specified size and its alloc status.
  *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ *       If the previous block is allocated, the second bit is set to 1.
+ *       If the previous block is a mini block, the third bit is set to 1.
  */
-static word_t pack(size_t size, bool alloc)
+static word_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
-	return alloc ? (size | alloc_mask) : size;
+	word_t result = size;
+
+	if(alloc) {
+		result |= alloc_mask;
+	}
+
+	if(prev_alloc) {
+		result |= prev_alloc_mask;
+	}
+
+	if(prev_mini) {
+		result |= prev_mini_mask;
+	}
+
+	return result;
 }
 
 /*
@@ -578,26 +869,71 @@ static bool get_alloc(block_t *block)
 	return extract_alloc(block->header);
 }
 
+static bool extract_prev_alloc(word_t word)
+{
+	return (bool) (word & prev_alloc_mask);
+}
+
+
+static bool Is_prev_alloc(block_t *block)
+{
+	return extract_prev_alloc(block->header);
+}
+
+/*
+ * set_prev_alloc: updates only the previous-block-allocated bit of the
+ *                 block header, leaving the size and alloc status alone.
+ */
+static void set_prev_alloc(block_t *block, bool prev_alloc)
+{
+	if(prev_alloc) {
+		block->header |= prev_alloc_mask;
+	}else{
+		block->header &= ~prev_alloc_mask;
+	}
+}
+
+static bool Is_prev_mini(block_t *block)
+{
+	return (bool) (block->header & prev_mini_mask);
+}
+
+/*
+ * set_prev_mini: updates only the previous-block-is-mini bit of the
+ *                block header.
+ */
+static void set_prev_mini(block_t *block, bool prev_mini)
+{
+	if(prev_mini) {
+		block->header |= prev_mini_mask;
+	}else{
+		block->header &= ~prev_mini_mask;
+	}
+}
+
 
 /*
  * write_header: given a block and its size and allocation status,
  *               writes an appropriate value to the block header.
  */
-static void write_header(block_t *block, size_t size, bool alloc)
+static void write_header(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
-	block->header = pack(size, alloc);
+	block->header = pack(size, alloc, prev_alloc, prev_mini);
 }
 
 
 /*
  * write_footer: given a block and its size and allocation status,
  *               writes an appropriate value to the block footer by first
- *               computing the position of the footer.
+ *               computing the position of the footer. Mini blocks have
+ *               no footer, so nothing is written for them.
  */
-static void write_footer(block_t *block, size_t size, bool alloc)
+static void write_footer(block_t *block, size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
+	if(size == mini_block_size) return;
+
 	word_t *footerp = header_to_footer(block);
-	*footerp = pack(size, alloc);
+	*footerp = pack(size, alloc, prev_alloc, prev_mini);
 }
 
 
@@ -624,10 +960,15 @@ static word_t *find_prev_footer(block_t *block)
 /*
  * find_prev: returns the previous block position by checking the previous
  *            block's footer and calculating the start of the previous block
- *            based on its size.
+ *            based on its size. A mini block is always one mini block
+ *            size back, as it has no footer.
  */
 static block_t *find_prev(block_t *block)
 {
+	if(Is_prev_mini(block)) {
+		return (block_t *) ((unsigned char *) block - mini_block_size);
+	}
+
 	word_t *footerp = find_prev_footer(block);
 	size_t size = extract_size(*footerp);
 	return (block_t *) ((unsigned char *) block - size);
@@ -666,7 +1007,7 @@ static word_t *header_to_footer(block_t *block)
 static word_t get_payload_size(block_t *block)
 {
 	size_t asize = get_size(block);
-	return asize - dsize;
+	return asize - wsize;
 }
 
 
@@ -693,31 +1034,33 @@ static void append_free_list_LIFO(block_t* block){
 }
 
 
+/*
+ * append_free_list_by_sequence: keeps the free list in address order with
+ *                               free_list_root as the lowest block. The
+ *                               skip list brings the search down to the
+ *                               last block below on level 1, and the rest
+ *                               is a short walk on the free list
+ */
 static void append_free_list_by_sequence(block_t* block){
-	// only one node in free list
-	if(free_list_len == 1) {
-		connect_block(block);
-		free_list_root = (block < free_list_root) ? block : free_list_root;
-	}
+	block_t *temp = skip_insert(block);
 
-	// check if the block is smaller than the start
-	if(block < free_list_root) {
+	// the lowest block becomes the start, at the end of the circle
+	if(temp == NULL && block < free_list_root) {
 		connect_block(block);
 		free_list_root = block;
-	}else if(block > free_list_root->previous) {
-		connect_block(block);
-	}else{
-		block_t *temp = free_list_root;
-
-		do{
-			if(block > temp && block < temp->next) {
-				block->next = temp->next;
-				block->previous = temp;
-				temp->next->previous = block;
-				temp->next = block;
-			}
-		}while(temp != free_list_root);
+		return;
+	}
+
+	if(temp == NULL) temp = free_list_root;
+
+	while(temp->next != free_list_root && temp->next < block) {
+		temp = temp->next;
 	}
+
+	block->next = temp->next;
+	block->previous = temp;
+	temp->next->previous = block;
+	temp->next = block;
 }
 
 static void append_free_list(block_t* block, const int type) { // 1 for LIFO, 2 for FIFO, 3 for ordered
@@ -726,6 +1069,23 @@ static void append_free_list(block_t* block, const int type) { // 1 for LIFO, 2
 		exit(-1);
 	}
 
+	// mini blocks have their own list, large blocks go to the size tree
+	if(get_size(block) == mini_block_size) {
+		append_mini_list(block);
+		return;
+	}
+
+	if(is_small_listed(block)) {
+		append_small_list(block);
+		return;
+	}
+
+	if(get_size(block) >= tree_threshold) {
+		tree_len += 1;
+		tree_root = tree_insert(tree_root, block);
+		return;
+	}
+
 	free_list_len += 1;
 
 	// during init process
@@ -734,6 +1094,7 @@ static void append_free_list(block_t* block, const int type) { // 1 for LIFO, 2
 		free_list_root = block;
 		free_list_root->previous = free_list_root;
 		free_list_root->next = free_list_root;
+		if(type == 3) skip_insert(block);
 		return;
 	}
 
@@ -750,10 +1111,34 @@ static void append_free_list(block_t* block, const int type) { // 1 for LIFO, 2
 // for coalesce
 // try to directly connect the block->prev to block->next
 static void disconnect_block(block_t* block) {
+	if(Is_unsorted(block)) {
+		disconnect_unsorted(block);
+		return;
+	}
+
+	if(get_size(block) == mini_block_size) {
+		disconnect_mini_block(block);
+		return;
+	}
+
+	if(is_small_listed(block)) {
+		disconnect_small_block(block);
+		return;
+	}
+
+	if(get_size(block) >= tree_threshold) {
+		tree_len--;
+		tree_root = tree_remove(tree_root, block);
+		return;
+	}
+
 	free_list_len--;
 
+	if(add_type == 3) skip_remove(block);
+
 	if(free_list_len == 0) {
 		free_list_root = NULL;
+		next_fit_ptr = NULL;
 		return;
 	}
 
@@ -768,7 +1153,390 @@ static void disconnect_block(block_t* block) {
 }
 
 
+static void append_mini_list(block_t *block) {
+	mini_list_len += 1;
+	block->mini_next = mini_list_root;
+	mini_list_root = block;
+}
+
+/*
+ * disconnect_mini_block: the mini list has no back links, so unlinking
+ *                        anything but the head walks the list to find
+ *                        the predecessor
+ */
+static void disconnect_mini_block(block_t *block) {
+	mini_list_len--;
+
+	if(block == mini_list_root) {
+		mini_list_root = block->mini_next;
+		return;
+	}
 
+	block_t *temp = mini_list_root;
+	while(temp->mini_next != block) {
+		temp = temp->mini_next;
+	}
+	temp->mini_next = block->mini_next;
+}
 
 
+/*
+ * is_small_listed: returns true for a free block that belongs on the small
+ *                  list, which only the address-ordered mode uses
+ */
+static bool is_small_listed(block_t *block) {
+	return add_type == 3 && get_size(block) == small_block_size;
+}
+
+static void append_small_list(block_t *block) {
+	small_list_len += 1;
+
+	if(small_list_root == NULL) {
+		block->previous = block;
+		block->next = block;
+		small_list_root = block;
+		return;
+	}
+
+	block->next = small_list_root;
+	block->previous = small_list_root->previous;
+	small_list_root->previous->next = block;
+	small_list_root->previous = block;
+	small_list_root = block;
+}
+
+static void disconnect_small_block(block_t *block) {
+	small_list_len--;
+
+	if(small_list_len == 0) {
+		small_list_root = NULL;
+		return;
+	}
+
+	block->previous->next = block->next;
+	block->next->previous = block->previous;
+	if(block == small_list_root) small_list_root = block->next;
+}
+
+
+static bool Is_unsorted(block_t *block)
+{
+	return (bool) (block->header & unsorted_mask);
+}
+
+/*
+ * append_unsorted: puts a free block at the end of the unsorted bin and
+ *                  flags it, so disconnect_block knows where it is
+ */
+static void append_unsorted(block_t *block) {
+	block->header |= unsorted_mask;
+	unsorted_len += 1;
+
+	if(unsorted_root == NULL) {
+		unsorted_root = block;
+		block->previous = block;
+		block->next = block;
+		return;
+	}
+
+	block->next = unsorted_root;
+	block->previous = unsorted_root->previous;
+	unsorted_root->previous->next = block;
+	unsorted_root->previous = block;
+}
+
+static void disconnect_unsorted(block_t *block) {
+	block->header &= ~unsorted_mask;
+	unsorted_len--;
+
+	if(unsorted_len == 0) {
+		unsorted_root = NULL;
+		return;
+	}
+
+	block->previous->next = block->next;
+	block->next->previous = block->previous;
+	if(block == unsorted_root) unsorted_root = block->next;
+}
+
+/*
+ * unsorted_fit: walks the unsorted bin in the order the blocks were freed.
+ *               An exact fit is returned still in the bin, every block
+ *               passed before it is moved to where add_type puts it
+ */
+static block_t *unsorted_fit(size_t asize) {
+	block_t *block;
+
+	while((block = unsorted_root) != NULL) {
+		if(get_size(block) == asize) return block;
+
+		disconnect_unsorted(block);
+		append_free_list(block, add_type);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * skip_next: returns the link to the successor of block on the given
+ *            level, where a NULL block stands for the head of the level
+ */
+static block_t **skip_next(block_t *block, int level) {
+	if(block == NULL) return &skip_head[level];
+	return &block->skip[level - 1];
+}
+
+/*
+ * skip_find_prev: fills update with the last block below the given block
+ *                 on every level from 1 up, and returns the one of level 1
+ */
+static block_t *skip_find_prev(block_t *block, block_t **update) {
+	block_t *temp = NULL;
+	block_t *next;
+
+	for(int level = SKIP_LEVELS - 1; level >= 1; level--) {
+		while((next = *skip_next(temp, level)) != NULL && next < block) {
+			temp = next;
+		}
+		update[level] = temp;
+	}
+
+	return temp;
+}
+
+/*
+ * skip_height: draws a geometric tower height, capped by the words the
+ *              block has between its list links and its footer
+ */
+static int skip_height(block_t *block) {
+	int max_height = get_size(block) / wsize - 3;
+	int height = 1;
+
+	// xorshift32
+	skip_seed ^= skip_seed << 13;
+	skip_seed ^= skip_seed >> 17;
+	skip_seed ^= skip_seed << 5;
+
+	uint32_t bits = skip_seed;
+	while(height < max_height && height < SKIP_LEVELS && (bits & 1)) {
+		height++;
+		bits >>= 1;
+	}
 
+	return height;
+}
+
+/*
+ * skip_insert: links the upper levels of a new tower for block and returns
+ *              the last block below it on level 1, or NULL if there is none
+ */
+static block_t *skip_insert(block_t *block) {
+	block_t *update[SKIP_LEVELS];
+	block_t *temp = skip_find_prev(block, update);
+	int height = skip_height(block);
+
+	for(int level = 1; level < height; level++) {
+		block_t **link = skip_next(update[level], level);
+		block->skip[level - 1] = *link;
+		*link = block;
+	}
+
+	return temp;
+}
+
+/*
+ * skip_remove: unlinks the upper levels of the tower of block, the caller
+ *              takes care of level 0
+ */
+static void skip_remove(block_t *block) {
+	block_t *update[SKIP_LEVELS];
+	skip_find_prev(block, update);
+
+	for(int level = 1; level < SKIP_LEVELS; level++) {
+		block_t **link = skip_next(update[level], level);
+		if(*link != block) break;
+		*link = block->skip[level - 1];
+	}
+}
+
+
+/*
+ * tree_best_fit: returns the smallest free block of the size tree that is
+ *                at least asize bytes, preferring a chained block so that
+ *                taking it does not change the shape of the tree
+ */
+static block_t *tree_best_fit(size_t asize) {
+	block_t *node = tree_root;
+	block_t *best_node = NULL;
+
+	while(node != NULL) {
+		if(get_size(node) == asize) {
+			best_node = node;
+			break;
+		}
+
+		if(get_size(node) > asize) {
+			best_node = node;
+			node = node->left;
+		}else{
+			node = node->right;
+		}
+	}
+
+	if(best_node == NULL) return NULL; // no fit found
+
+	return (best_node->next != NULL) ? best_node->next : best_node;
+}
+
+// insert the block into the subtree rooted at node, returns the new subtree root
+static block_t *tree_insert(block_t *node, block_t *block) {
+	if(node == NULL) {
+		block->left = NULL;
+		block->right = NULL;
+		block->previous = NULL;
+		block->next = NULL;
+		block->height = 1;
+		return block;
+	}
+
+	if(get_size(block) == get_size(node)) {
+		// push it on the chain of the node, the tree shape does not change
+		block->height = 0;
+		block->previous = node;
+		block->next = node->next;
+		if(node->next != NULL) node->next->previous = block;
+		node->next = block;
+		return node;
+	}
+
+	if(get_size(block) < get_size(node)) {
+		node->left = tree_insert(node->left, block);
+	}else{
+		node->right = tree_insert(node->right, block);
+	}
+
+	return tree_balance(node);
+}
+
+// remove the block from the subtree rooted at node, returns the new subtree root
+static block_t *tree_remove(block_t *node, block_t *block) {
+	block_t *min;
+
+	// chained blocks are unlinked without touching the tree
+	if(block->height == 0) {
+		block->previous->next = block->next;
+		if(block->next != NULL) block->next->previous = block->previous;
+		return node;
+	}
+
+	if(get_size(block) < get_size(node)) {
+		node->left = tree_remove(node->left, block);
+		return tree_balance(node);
+	}
+
+	if(get_size(block) > get_size(node)) {
+		node->right = tree_remove(node->right, block);
+		return tree_balance(node);
+	}
+
+	// node == block: promote the head of its chain if there is one
+	if(block->next != NULL) {
+		block_t *heir = block->next;
+		heir->left = block->left;
+		heir->right = block->right;
+		heir->height = block->height;
+		heir->previous = NULL;
+		if(heir->next != NULL) heir->next->previous = heir;
+		return heir;
+	}
+
+	if(block->left == NULL) return block->right;
+	if(block->right == NULL) return block->left;
+
+	// replace it by the smallest node of its right subtree
+	block_t *right = tree_remove_min(block->right, &min);
+	min->left = block->left;
+	min->right = right;
+	return tree_balance(min);
+}
+
+// detach the smallest node of the subtree into *min, returns the new subtree root
+static block_t *tree_remove_min(block_t *node, block_t **min) {
+	if(node->left == NULL) {
+		*min = node;
+		return node->right;
+	}
+
+	node->left = tree_remove_min(node->left, min);
+	return tree_balance(node);
+}
+
+// restore the AVL property at node after one of its subtrees changed
+static block_t *tree_balance(block_t *node) {
+	word_t left_height = tree_height(node->left);
+	word_t right_height = tree_height(node->right);
+
+	if(left_height > right_height + 1) {
+		if(tree_height(node->left->right) > tree_height(node->left->left)) {
+			node->left = tree_rotate_left(node->left);
+		}
+		return tree_rotate_right(node);
+	}
+
+	if(right_height > left_height + 1) {
+		if(tree_height(node->right->left) > tree_height(node->right->right)) {
+			node->right = tree_rotate_right(node->right);
+		}
+		return tree_rotate_left(node);
+	}
+
+	tree_update_height(node);
+	return node;
+}
+
+static block_t *tree_rotate_left(block_t *node) {
+	block_t *pivot = node->right;
+
+	node->right = pivot->left;
+	pivot->left = node;
+	tree_update_height(node);
+	tree_update_height(pivot);
+	return pivot;
+}
+
+static block_t *tree_rotate_right(block_t *node) {
+	block_t *pivot = node->left;
+
+	node->left = pivot->right;
+	pivot->right = node;
+	tree_update_height(node);
+	tree_update_height(pivot);
+	return pivot;
+}
+
+static word_t tree_height(block_t *node) {
+	return (node == NULL) ? 0 : node->height;
+}
+
+static void tree_update_height(block_t *node) {
+	word_t left_height = tree_height(node->left);
+	word_t right_height = tree_height(node->right);
+
+	node->height = 1 + ((left_height > right_height) ? left_height : right_height);
+}
+
+// check that the block is a tree node or on the chain of one
+static bool find_block_in_tree(block_t *target) {
+	block_t *node = tree_root;
+
+	while(node != NULL && get_size(node) != get_size(target)) {
+		node = (get_size(target) < get_size(node)) ? node->left : node->right;
+	}
+
+	for(; node != NULL; node = node->next) {
+		if(node == target) return true;
+	}
+
+	return false;
+}
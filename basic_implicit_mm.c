@@ -247,6 +247,15 @@ void *mm_realloc(void *ptr, size_t size) {
 	return newptr;
 }
 
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
 /* Print status of every block in heap */
 void mm_status(FILE *fp) {
 	block_t *block = heap_start;
@@ -350,6 +359,9 @@ static block_t *extend_heap(size_t size)
 
 	// Allocate an even number of words to maintain alignment
 	size = round_up(size, dsize);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
 	if ((bp = mem_sbrk(size)) == (void *)-1)
 	{
 		return NULL;
@@ -0,0 +1,849 @@
+/*
+ ******************************************************************************
+ *                                   mm.c                                     *
+ *        64-bit struct-based segregated list allocator with bin locks        *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *             Modified version of one provided to students in malloc lab     *
+ *  This version is thread-safe with one lock per size class instead of one   *
+ *  for the heap, so threads working on different classes of the same heap    *
+ *  run in parallel. A free block, its header, footer and list links, is      *
+ *  only ever changed under the lock of its class. A block taken off a list   *
+ *  stays marked allocated until it is put back, so it belongs to one thread  *
+ *  meanwhile. Coalescing reads the neighbors without a lock, takes the       *
+ *  locks of their classes and of the merged block's class in ascending       *
+ *  order, and starts over if a neighbor changed before it got them.          *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+team_t team = {
+		/* Team name */
+		"ateam",
+		/* First member's full name */
+		"Harry Bovik",
+		/* First member's email address */
+		"bovik@cs.cmu.edu",
+		/* Second member's full name (leave blank if none) */
+		"",
+		/* Second member's email address (leave blank if none) */
+		""
+};
+
+/* Basic constants */
+
+typedef uint64_t word_t;
+
+// Word and header size (bytes)
+static const size_t wsize = sizeof(word_t);
+
+// Double word size (bytes)
+static const size_t dsize = 2 * sizeof(word_t);
+
+/*
+  Minimum useable block size (bytes):
+  two words for header & footer, two words for payload
+*/
+static const size_t min_block_size = 4 * sizeof(word_t);
+
+// Mask to extract allocated bit from header
+static const word_t alloc_mask = 0x1;
+
+/*
+ * Assume: All block sizes are a multiple of 16
+ * and so can use lower 4 bits for flags
+ */
+static const word_t size_mask = ~(word_t) 0xF;
+
+static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
+
+/*
+  Size classes as in the segregated list allocator with exact small bins:
+  one bin per block size up to 2^small_bin_shift bytes, power-of-two
+  classes above that, and the last class collects everything bigger.
+*/
+#define NUM_CLASSES 128
+#define BITMAP_WORDS (NUM_CLASSES / 64)
+static const int small_bin_shift = 10;
+
+// Most bin locks one coalescing step holds: both neighbors and the result
+#define MAX_HELD 3
+
+/*
+  All blocks have both headers and footers
+
+  Both the header and the footer consist of a single word containing the
+  size and the allocation flag, where size is the total size of the block,
+  including header, (possibly payload), unused space, and footer
+
+  Headers and footers may be read by other threads without a lock, so
+  they are always written whole, with atomic stores.
+*/
+
+/* Representation of the header and payload of one block in the heap */
+typedef struct block
+{
+	word_t header;
+	/*
+	 * We don't know what the size of the payload will be, so we will
+	 * declare it as a zero-length array.  This allow us to obtain a
+	 * pointer to the start of the payload.
+	 */
+
+	unsigned char payload[0];
+	struct block *previous;
+	struct block *next;
+
+} block_t;
+
+/* One size class, on cache lines of its own */
+typedef struct bin
+{
+	pthread_mutex_t lock;
+
+	// Root of the circular free list of the class
+	block_t *root;
+
+	size_t contended;  // lock attempts that found the lock taken
+
+} __attribute__((aligned(64))) bin_t;
+
+
+/* Global variables */
+
+static bin_t bins[NUM_CLASSES];
+
+// Bit i is set when bins[i] is non-empty, changed atomically under bin i's lock
+static uint64_t class_bitmap[BITMAP_WORDS];
+
+// Serializes growing the heap and guards heap_end
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+static block_t *heap_end = NULL;
+
+/* Function prototypes for internal helper routines */
+
+static block_t *find_fit(size_t asize);
+static block_t *search_class(int class, size_t asize);
+static block_t *coalesce_block(block_t *block, bool publish);
+static void split_block(block_t *block, size_t asize);
+static block_t *extend_heap(size_t size);
+
+static size_t round_up(size_t size, size_t n);
+static word_t pack(size_t size, bool alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc);
+static void write_footer(block_t *block, size_t size, bool alloc);
+static word_t read_word(word_t *word);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+static word_t *header_to_footer(block_t *block);
+
+static block_t *find_next(block_t *block);
+static word_t *find_prev_footer(block_t *block);
+void mm_status();
+static word_t get_payload_size(block_t *block);
+
+// functions only for segregated list
+void free_list_status();
+static int find_class(size_t asize);
+static bool is_exact_class(int class);
+static int next_nonempty_class(int class);
+static void append_free_list(block_t *block);
+static void disconnect_block(block_t *block);
+
+// functions only for bin locks
+static void lock_bin(int class);
+static void unlock_bin(int class);
+static int lock_bins(int *classes, int count);
+static void unlock_bins(int *classes, int count);
+
+void log_block(block_t *block){
+	bool is_allocate = get_alloc(block);
+	printf("Block address %p,  size = %zd, allocated = %s, ",
+	       block,
+	       get_size(block),
+	       is_allocate ? "Y" : "N");
+
+	if(!is_allocate) {
+		block_t *prev_free = block->previous, *next_free = block->next;
+		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
+	}
+
+	printf("\n");
+}
+
+
+/*
+  Initialize the heap with a prologue footer and an epilogue header and
+  no free block. Must not run while other threads use the allocator.
+ */
+int mm_init()
+{
+	int class;
+
+	word_t *start = (word_t*)(mem_sbrk(2 * wsize));
+	if(start == (void *)-1) {
+		return -1;
+	}
+
+	start[0] = pack(0, true); // Prologue footer
+	start[1] = pack(0, true); // Epilogue header
+
+	heap_end = (block_t *) &start[1];
+
+	for(class = 0; class < NUM_CLASSES; class++) {
+		pthread_mutex_init(&bins[class].lock, NULL);
+		bins[class].root = NULL;
+		bins[class].contended = 0;
+	}
+	memset(class_bitmap, 0, sizeof(class_bitmap));
+
+	return 0;
+}
+
+/*
+ * Allocate space for payload of size bytes. The block comes off a free
+ * list, or else from a new chunk merged with the free block before it.
+ */
+void *mm_malloc(size_t size)
+{
+	size_t asize;      // Allocated block size
+	block_t *block = NULL;
+
+	if (size == 0) // Ignore spurious request
+		return NULL;
+
+	asize = round_up(size + dsize, dsize);
+
+	if((block = find_fit(asize)) == NULL) {
+		if((block = extend_heap(asize)) == NULL) {
+			return NULL;
+		}
+		block = coalesce_block(block, false);
+	}
+
+	// Try to split the block if too large
+	split_block(block, asize);
+
+	return header_to_payload(block);
+}
+
+/* Free allocated block */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	block_t *block = payload_to_header(bp);
+
+	// The block should be marked as allocated
+	if (!get_alloc(block)) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	// Coalesce the block with its neighbors and put it on its list
+	coalesce_block(block, true);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+	size_t copysize;
+	void *newptr;
+
+	// If size == 0, then free block and return NULL
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+	{
+		return mm_malloc(size);
+	}
+
+	// Otherwise, proceed with reallocation
+	newptr = mm_malloc(size);
+	// If malloc fails, the original block is left untouched
+	if (!newptr)
+	{
+		return NULL;
+	}
+
+	// Copy the old data
+	copysize = mm_usable_size(ptr); // gets size of old payload
+	if(size < copysize)
+	{
+		copysize = size;
+	}
+	memcpy(newptr, ptr, copysize);
+
+	// Free the old block
+	mm_free(ptr);
+
+	return newptr;
+}
+
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
+/* Print how often the lock of every class was found taken */
+void mm_status() {
+	int class;
+
+	printf("The status of %d bin locks\n", NUM_CLASSES);
+	printf("*******************************\n");
+	for(class = 0; class < NUM_CLASSES; class++) {
+		if(bins[class].contended == 0) continue;
+
+		printf("Size class %d: contended = %zu\n", class, bins[class].contended);
+	}
+	printf("*******************************\n");
+}
+
+/* Print every non-empty size class, only while no other thread runs */
+void free_list_status() {
+	int class;
+
+	for(class = 0; class < NUM_CLASSES; class++) {
+		block_t *block = bins[class].root;
+		if(block == NULL) continue;
+
+		printf("Size class %d\n", class);
+		printf("-------------------------------\n");
+		do{
+			log_block(block);
+			block = block->next;
+		}while(block != bins[class].root);
+		printf("-------------------------------\n");
+	}
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+
+/*
+ * Coalesce a block this thread holds, marked allocated, with its free
+ * neighbors. With publish, the result is marked free and put into its
+ * class, otherwise it stays allocated and is returned to the caller.
+ *
+ * The neighbors are read without a lock first, to learn which classes to
+ * lock. A free neighbor cannot change while its class is locked, so if it
+ * still reads the same afterwards it is really that free block. If either
+ * neighbor changed meanwhile, all locks are dropped and the step starts
+ * over. A neighbor freed after the check is not merged; two free blocks
+ * can then sit side by side, which costs space but nothing else.
+ */
+static block_t *coalesce_block(block_t *block, bool publish)
+{
+	size_t size = get_size(block);
+	block_t *block_next = find_next(block);
+	int classes[MAX_HELD];
+	int count;
+
+	while(true) {
+		word_t next_header = read_word(&block_next->header);
+		word_t prev_footer = read_word(find_prev_footer(block));
+		bool next_alloc = extract_alloc(next_header);
+		bool prev_alloc = extract_alloc(prev_footer);
+		size_t total = size;
+
+		count = 0;
+		if(!next_alloc) {
+			total += extract_size(next_header);
+			classes[count++] = find_class(extract_size(next_header));
+		}
+		if(!prev_alloc) {
+			total += extract_size(prev_footer);
+			classes[count++] = find_class(extract_size(prev_footer));
+		}
+		if(publish) {
+			classes[count++] = find_class(total);
+		}
+
+		count = lock_bins(classes, count);
+
+		if(read_word(&block_next->header) != next_header ||
+		   read_word(find_prev_footer(block)) != prev_footer) {
+			unlock_bins(classes, count);
+			continue;
+		}
+
+		block_t *block_prev = (block_t *) ((unsigned char *) block - extract_size(prev_footer));
+
+		// A free footer of a locked class belongs to a block in that class
+		if(!prev_alloc && read_word(&block_prev->header) != prev_footer) {
+			unlock_bins(classes, count);
+			continue;
+		}
+
+		if(!next_alloc) disconnect_block(block_next);
+		if(!prev_alloc) {
+			disconnect_block(block_prev);
+			block = block_prev;
+		}
+
+		write_header(block, total, !publish);
+		write_footer(block, total, !publish);
+		if(publish) append_free_list(block);
+
+		unlock_bins(classes, count);
+		return block;
+	}
+}
+
+
+/*
+ * See if new block can be split one to satisfy allocation and one to keep
+ * free. The block belongs to this thread. The remainder is only written
+ * as a free block under the lock of its class.
+ */
+static void split_block(block_t *block, size_t asize)
+{
+	size_t block_size = get_size(block);
+
+	if ((block_size - asize) >= min_block_size)
+	{
+		int class = find_class(block_size - asize);
+
+		lock_bin(class);
+
+		write_header(block, asize, true);
+		write_footer(block, asize, true);
+
+		block_t *block_next = find_next(block);
+		write_header(block_next, block_size - asize, false);
+		write_footer(block_next, block_size - asize, false);
+
+		append_free_list(block_next);
+		unlock_bin(class);
+	}
+}
+
+
+/*
+ * Find a free block of size at least asize, looking only at the class of
+ * the request and the non-empty classes above it, one class lock at a
+ * time. The block is taken off its list and returned marked allocated.
+ */
+static block_t *find_fit(size_t asize) {
+	int class;
+	block_t *block;
+
+	for(class = next_nonempty_class(find_class(asize));
+	    class >= 0;
+	    class = next_nonempty_class(class + 1)) {
+		lock_bin(class);
+
+		if((block = search_class(class, asize)) != NULL) {
+			disconnect_block(block);
+
+			size_t block_size = get_size(block);
+			write_header(block, block_size, true);
+			write_footer(block, block_size, true);
+
+			unlock_bin(class);
+			return block;
+		}
+
+		unlock_bin(class);
+	}
+
+	return NULL; // no fit found
+}
+
+/*
+ * Best fit inside one locked size class
+ */
+static block_t *search_class(int class, size_t asize) {
+	block_t *root = bins[class].root;
+	block_t *block = root;
+	block_t *best_block = NULL;
+
+	if(root == NULL) return NULL;
+
+	// every block of an exact bin has the same size
+	if(is_exact_class(class)) return (asize <= get_size(root)) ? root : NULL;
+
+	do{
+		if (asize <= get_size(block)) {
+			if(best_block == NULL || (get_size(best_block) > get_size(block))){
+				best_block = block;
+				if(get_size(block) == asize) break;
+			}
+		}
+
+		block = block->next;
+
+	}while(block != root);
+
+	return best_block;
+}
+
+/*
+ * Grow the heap by at least size bytes and return the new space as one
+ * block marked allocated, not yet coalesced. The old epilogue becomes its
+ * header, and stays marked allocated throughout.
+ */
+static block_t *extend_heap(size_t size)
+{
+	void *bp;
+	block_t *block;
+
+	size = round_up(size < chunksize ? chunksize : size, dsize);
+
+	pthread_mutex_lock(&sbrk_lock);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+	{
+		pthread_mutex_unlock(&sbrk_lock);
+		return NULL;
+	}
+
+	block = heap_end;
+	write_header(block, size, true);
+	write_footer(block, size, true);
+
+	// Create new epilogue header
+	heap_end = find_next(block);
+	write_header(heap_end, 0, true);
+	pthread_mutex_unlock(&sbrk_lock);
+
+	return block;
+}
+
+/*
+ *****************************************************************************
+ * The functions below take and release the locks of the size classes.     *
+ * Whoever holds more than one took them in ascending class order, so no   *
+ * two threads wait for each other.                                          *
+ *****************************************************************************
+ */
+
+
+static void lock_bin(int class)
+{
+	if(pthread_mutex_trylock(&bins[class].lock) == 0) {
+		return;
+	}
+
+	__atomic_fetch_add(&bins[class].contended, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&bins[class].lock);
+}
+
+static void unlock_bin(int class)
+{
+	pthread_mutex_unlock(&bins[class].lock);
+}
+
+/*
+ * lock_bins: sorts classes, drops duplicates and locks the rest in
+ *            ascending order. Returns the number of classes left.
+ */
+static int lock_bins(int *classes, int count)
+{
+	int i, j, unique = 0;
+
+	for(i = 1; i < count; i++) {
+		int class = classes[i];
+		for(j = i; j > 0 && classes[j - 1] > class; j--) {
+			classes[j] = classes[j - 1];
+		}
+		classes[j] = class;
+	}
+
+	for(i = 0; i < count; i++) {
+		if(unique > 0 && classes[unique - 1] == classes[i]) continue;
+		classes[unique++] = classes[i];
+	}
+
+	for(i = 0; i < unique; i++) {
+		lock_bin(classes[i]);
+	}
+
+	return unique;
+}
+
+static void unlock_bins(int *classes, int count)
+{
+	while(count-- > 0) {
+		unlock_bin(classes[count]);
+	}
+}
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+	return n * ((size + (n-1)) / n);
+}
+
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ */
+static word_t pack(size_t size, bool alloc)
+{
+	return alloc ? (size | alloc_mask) : size;
+}
+
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+	return (word & size_mask);
+}
+
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the heap is 16-byte aligned).
+ */
+static size_t get_size(block_t *block)
+{
+	return extract_size(block->header);
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+	return (bool) (word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+	return extract_alloc(block->header);
+}
+
+
+/*
+ * write_header: given a block and its size and allocation status,
+ *               writes an appropriate value to the block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc)
+{
+	__atomic_store_n(&block->header, pack(size, alloc), __ATOMIC_RELAXED);
+}
+
+
+/*
+ * write_footer: given a block and its size and allocation status,
+ *               writes an appropriate value to the block footer by first
+ *               computing the position of the footer.
+ */
+static void write_footer(block_t *block, size_t size, bool alloc)
+{
+	word_t *footerp = header_to_footer(block);
+	__atomic_store_n(footerp, pack(size, alloc), __ATOMIC_RELAXED);
+}
+
+/*
+ * read_word: reads a header or footer another thread may be writing,
+ *            never torn
+ */
+static word_t read_word(word_t *word)
+{
+	return __atomic_load_n(word, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * find_next: returns the next consecutive block on the heap by adding the
+ *            size of the block.
+ */
+static block_t *find_next(block_t *block)
+{
+	return (block_t *) ((unsigned char *) block + get_size(block));
+}
+
+
+/*
+ * find_prev_footer: returns the footer of the previous block.
+ */
+static word_t *find_prev_footer(block_t *block)
+{
+	// Compute previous footer position as one word before the header
+	return &(block->header) - 1;
+}
+
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+	return (void *) (block->payload);
+}
+
+
+/*
+ * header_to_footer: given a block pointer, returns a pointer to the
+ *                   corresponding footer.
+ */
+static word_t *header_to_footer(block_t *block)
+{
+	return (word_t *) (block->payload + get_size(block) - dsize);
+}
+
+static word_t get_payload_size(block_t *block)
+{
+	size_t asize = get_size(block);
+	return asize - dsize;
+}
+
+/*
+ * find_class: maps a block size to its size class, using
+ *             count-leading-zeros to find the power-of-two class.
+ */
+static int find_class(size_t asize)
+{
+	int class, exact_bins, log_size;
+
+	if(asize <= min_block_size) return 0;
+
+	exact_bins = ((1 << small_bin_shift) - min_block_size) / dsize + 1;
+	if(asize <= ((size_t) 1 << small_bin_shift)) {
+		return (asize - min_block_size) / dsize;
+	}
+
+	// smallest k with asize <= 2^k
+	log_size = 64 - __builtin_clzll((unsigned long long) (asize - 1));
+	class = exact_bins + log_size - small_bin_shift - 1;
+
+	return (class < NUM_CLASSES - 1) ? class : NUM_CLASSES - 1;
+}
+
+/*
+ * is_exact_class: returns true when the class only holds blocks of a single size
+ */
+static bool is_exact_class(int class)
+{
+	return class < ((1 << small_bin_shift) - (int) min_block_size) / (int) dsize + 1;
+}
+
+/*
+ * next_nonempty_class: returns the first class not below class that looked
+ *                      non-empty, or -1 if there is none. Read without
+ *                      locks, so the caller checks again under the lock.
+ */
+static int next_nonempty_class(int class)
+{
+	int word;
+	uint64_t bits;
+
+	if(class >= NUM_CLASSES) return -1;
+
+	word = class / 64;
+	bits = __atomic_load_n(&class_bitmap[word], __ATOMIC_RELAXED) & (~(uint64_t) 0 << (class % 64));
+
+	while(bits == 0) {
+		if(++word == BITMAP_WORDS) return -1;
+		bits = __atomic_load_n(&class_bitmap[word], __ATOMIC_RELAXED);
+	}
+
+	return word * 64 + __builtin_ctzll(bits);
+}
+
+// put the block at the front of the circular list of its locked size class
+static void append_free_list(block_t *block) {
+	if(get_alloc(block)) {
+		fprintf(stderr, "Cannot add an allocated ptr to the free list\n");
+		exit(-1);
+	}
+
+	int class = find_class(get_size(block));
+	block_t *root = bins[class].root;
+
+	bins[class].root = block;
+
+	// empty class, the block becomes its own circle
+	if(root == NULL) {
+		block->previous = block;
+		block->next = block;
+		__atomic_fetch_or(&class_bitmap[class / 64], (uint64_t) 1 << (class % 64), __ATOMIC_RELAXED);
+		return;
+	}
+
+	// connect the block to the prev of the root
+	block->next = root;
+	block->previous = root->previous;
+	root->previous->next = block;
+	root->previous = block;
+}
+
+// take the block out of the circular list of its locked size class
+static void disconnect_block(block_t *block) {
+	int class = find_class(get_size(block));
+
+	if(block->next == block) {
+		bins[class].root = NULL;
+		__atomic_fetch_and(&class_bitmap[class / 64], ~((uint64_t) 1 << (class % 64)), __ATOMIC_RELAXED);
+		return;
+	}
+
+	block_t *cur_prev = block->previous, *cur_next = block->next;
+	cur_prev->next = cur_next;
+	cur_next->previous = cur_prev;
+
+	if(block == bins[class].root) bins[class].root = cur_next;
+}
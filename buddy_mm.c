@@ -0,0 +1,630 @@
+/*
+ ******************************************************************************
+ *                                   mm.c                                     *
+ *             64-bit struct-based binary buddy memory allocator              *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *             Modified version of one provided to students in malloc lab     *
+ *  This version only hands out blocks whose size is a power of two, aligned  *
+ *  to their size relative to the start of the heap. The buddy of a block is  *
+ *  found by flipping one bit of its offset, so no footers are needed         *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {
+		/* Team name */
+		"ateam",
+		/* First member's full name */
+		"Harry Bovik",
+		/* First member's email address */
+		"bovik@cs.cmu.edu",
+		/* Second member's full name (leave blank if none) */
+		"",
+		/* Second member's email address (leave blank if none) */
+		""
+};
+
+/* Basic constants */
+
+typedef uint64_t word_t;
+
+// Word and header size (bytes)
+static const size_t wsize = sizeof(word_t);
+
+/*
+  Minimum block order: a free block needs a header and two list pointers,
+  so the smallest block is 2^5 = 32 bytes
+*/
+static const int min_order = 5;
+
+// Mask to extract allocated bit from header
+static const word_t alloc_mask = 0x1;
+
+/*
+ * Assume: All block sizes are a power of two of at least 32
+ * and so can use lower 4 bits for flags
+ */
+static const word_t size_mask = ~(word_t) 0xF;
+
+// The heap never grows by less than 2^chunk_order bytes
+static const int chunk_order = 12;
+
+// Largest block order, one free list per order up to it
+#define MAX_ORDER 40
+
+/*
+  Blocks only have a header, a single word containing the size and the
+  allocation flag. The size is always 2^order, including the header.
+*/
+
+/* Representation of the header and payload of one block in the heap */
+typedef struct block
+{
+	word_t header;
+	/*
+	 * We don't know what the size of the payload will be, so we will
+	 * declare it as a zero-length array.  This allow us to obtain a
+	 * pointer to the start of the payload.
+	 */
+
+	unsigned char payload[0];
+	struct block *previous;
+	struct block *next;
+
+} block_t;
+
+
+/* Global variables */
+
+// Address every buddy offset is relative to, the first block of the heap
+static unsigned char *heap_base = NULL;
+// Number of bytes of blocks, the heap ends at heap_base + heap_size
+static size_t heap_size = 0;
+
+// Head of the NULL terminated free list of every order
+static block_t *free_lists[MAX_ORDER + 1];
+// Bit k is set when free_lists[k] is non-empty
+static uint64_t order_bitmap;
+
+/* Function prototypes for internal helper routines */
+
+static block_t *find_fit(int order);
+static block_t *coalesce_block(block_t *block);
+static void split_block(block_t *block, int order);
+static bool grow_block(block_t *block, int order);
+
+static word_t pack(size_t size, bool alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+
+static block_t *find_buddy(block_t *block);
+static block_t *extend_heap(int order);
+static block_t *add_heap_block(size_t size);
+void mm_status();
+static word_t get_payload_size(block_t *block);
+
+// functions only for buddy system
+void free_list_status();
+static int find_order(size_t asize);
+static int get_order(block_t *block);
+static void append_free_list(block_t *block);
+static void disconnect_block(block_t *block);
+
+void log_block(block_t *block){
+	bool is_allocate = get_alloc(block);
+	printf("Block address %p,  size = %zd, allocated = %s, ",
+	       block,
+	       get_size(block),
+	       is_allocate ? "Y" : "N");
+
+	if(!is_allocate) {
+		block_t *prev_free = block->previous, *next_free = block->next;
+		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
+	}
+
+	printf("\n");
+}
+
+
+/*
+  Initialize an empty heap whose blocks start one word after the start
+  of the heap, so that payloads are 16-byte aligned.
+ */
+int mm_init()
+{
+	unsigned char *start = (unsigned char *)(mem_sbrk(wsize));
+	if(start == (void *)-1) {
+		return -1;
+	}
+
+	heap_base = start + wsize;
+	heap_size = 0;
+	order_bitmap = 0;
+	memset(free_lists, 0, sizeof(free_lists));
+
+	// Extend the empty heap with a free block of 2^chunk_order bytes
+	if (extend_heap(chunk_order) == NULL)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate space for payload of size bytes
+ */
+void *mm_malloc(size_t size)
+{
+	int order;         // Order of the allocated block
+	block_t *block = NULL;
+	void *bp = NULL;
+
+	if (size == 0) // Ignore spurious request
+		return bp;
+
+	if((order = find_order(size + wsize)) > MAX_ORDER)
+		return bp;
+
+	if((block = find_fit(order)) == NULL) {
+		// No free block is large enough, grow the heap
+		if((block = extend_heap(order > chunk_order ? order : chunk_order)) == NULL) {
+			return NULL;
+		}
+	}
+
+	disconnect_block(block);
+
+	// Halve the block down to the requested order
+	split_block(block, order);
+	write_header(block, get_size(block), true);
+	bp = header_to_payload(block);
+
+	return bp;
+}
+
+/* Free allocated block */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	block_t *block = payload_to_header(bp);
+	size_t size = get_size(block);
+
+	// The block should be marked as allocated
+	if (!get_alloc(block)) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	// Mark the block as free
+	write_header(block, size, false);
+
+	// Merge the block with its buddy as long as the buddy is free
+	coalesce_block(block);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+	size_t copysize;
+	void *newptr;
+	int order;
+
+	// If size == 0, then free block and return NULL
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+	{
+		return mm_malloc(size);
+	}
+
+	// Shrinking stays in place, the upper halves go back to the free lists
+	block_t *block = payload_to_header(ptr);
+	order = find_order(size + wsize);
+	if(order <= get_order(block)) {
+		split_block(block, order);
+		return ptr;
+	}
+
+	// Growing stays in place while the block can absorb its free buddies
+	if(grow_block(block, order)) {
+		return ptr;
+	}
+
+	// Otherwise, proceed with reallocation
+	newptr = mm_malloc(size);
+	// If malloc fails, the original block is left untouched
+	if (!newptr)
+	{
+		return NULL;
+	}
+
+	// Copy the old data
+	copysize = get_payload_size(block); // gets size of old payload
+	if(size < copysize)
+	{
+		copysize = size;
+	}
+	memcpy(newptr, ptr, copysize);
+
+	// Free the old block
+	mm_free(ptr);
+
+	return newptr;
+}
+
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
+/* Print status of every block in heap */
+void mm_status() {
+	block_t *block = (block_t *) heap_base;
+	printf("The whole heap status\n");
+	printf("*******************************\n");
+	while ((unsigned char *) block < heap_base + heap_size) {
+		log_block(block);
+		block = (block_t *) ((unsigned char *) block + get_size(block));
+	}
+	printf("*******************************\n");
+}
+
+/* Print every non-empty order */
+void free_list_status() {
+	int order;
+
+	for(order = min_order; order <= MAX_ORDER; order++) {
+		block_t *block = free_lists[order];
+		if(block == NULL) continue;
+
+		printf("Order %d\n", order);
+		printf("-------------------------------\n");
+		for(; block != NULL; block = block->next) {
+			log_block(block);
+		}
+		printf("-------------------------------\n");
+	}
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+
+/*
+ * Merge the free block with its buddy while the buddy is free and whole,
+ * then put the result on the list of its order. Returns the merged block.
+ */
+static block_t *coalesce_block(block_t *block)
+{
+	size_t size = get_size(block);
+	block_t *buddy;
+
+	while((buddy = find_buddy(block)) != NULL &&
+	      !get_alloc(buddy) && get_size(buddy) == size)
+	{
+		disconnect_block(buddy);
+
+		// the merged block starts at the lower of the two buddies
+		if(buddy < block) block = buddy;
+		size <<= 1;
+		write_header(block, size, false);
+	}
+
+	append_free_list(block);
+	return block;
+}
+
+
+/*
+ * Halve the block until it has the given order, putting every upper half
+ * on the free list of its order. The upper half's buddy is the lower half,
+ * which stays in use, so it needs no coalescing.
+ */
+static void split_block(block_t *block, int order)
+{
+	bool alloc = get_alloc(block);
+	size_t size = get_size(block);
+
+	while(size > ((size_t) 1 << order))
+	{
+		size >>= 1;
+
+		block_t *buddy = (block_t *) ((unsigned char *) block + size);
+		write_header(buddy, size, false);
+		append_free_list(buddy);
+	}
+
+	write_header(block, size, alloc);
+}
+
+
+/*
+ * Double the allocated block up to the given order by absorbing its upper
+ * buddies, which requires the block to be the lower half at every step
+ * and every buddy to be free and whole. Buddies past the end of the heap
+ * are taken from the memory system. Nothing changes unless all of them
+ * are available. Returns true if the block now has the given order.
+ */
+static bool grow_block(block_t *block, int order)
+{
+	size_t offset = (unsigned char *) block - heap_base;
+	size_t end = heap_size;
+	size_t size;
+
+	for(size = get_size(block); size < ((size_t) 1 << order); size <<= 1)
+	{
+		block_t *buddy = (block_t *) ((unsigned char *) block + size);
+
+		if((offset & size) != 0)
+			return false;
+		// the block reaches the end of the heap, the buddy is still unused
+		if(offset + size >= end)
+			continue;
+		if(offset + 2 * size > end || get_alloc(buddy) || get_size(buddy) != size)
+			return false;
+	}
+
+	if(offset + size > end) {
+		if(mem_sbrk(offset + size - end) == (void *) -1)
+			return false;
+		heap_size = offset + size;
+	}
+
+	for(size = get_size(block); size < ((size_t) 1 << order) && offset + size < end; size <<= 1)
+	{
+		disconnect_block((block_t *) ((unsigned char *) block + size));
+	}
+
+	write_header(block, (size_t) 1 << order, true);
+	return true;
+}
+
+
+/*
+ * Find a free block of at least the given order, taking the smallest
+ * non-empty order with one count-trailing-zeros. Within that order the
+ * lowest block is taken, which keeps the heap packed towards its start
+ * so the blocks near the end stay free and whole.
+ */
+static block_t *find_fit(int order) {
+	uint64_t orders = order_bitmap & (~(uint64_t) 0 << order);
+	block_t *block, *best;
+
+	if(orders == 0) return NULL; // no fit found
+
+	best = free_lists[__builtin_ctzll(orders)];
+	for(block = best->next; block != NULL; block = block->next) {
+		if(block < best) best = block;
+	}
+
+	return best;
+}
+
+/*
+ * Grow the heap until it ends with a free block of the given order. The
+ * heap first grows to a multiple of 2^order with the largest aligned blocks
+ * that fit, so every block stays aligned to its size. Returns the free
+ * block of the given order, possibly merged with its buddies.
+ */
+static block_t *extend_heap(int order)
+{
+	size_t size = (size_t) 1 << order;
+
+	while(heap_size % size != 0) {
+		// the lowest set bit is the largest block aligned at the end
+		if(add_heap_block(heap_size & (~heap_size + 1)) == NULL) {
+			return NULL;
+		}
+	}
+
+	return add_heap_block(size);
+}
+
+/*
+ * Take size more bytes from the memory system as one free block at the
+ * end of the heap, and merge it with its buddies
+ */
+static block_t *add_heap_block(size_t size)
+{
+	void *bp;
+
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+	{
+		return NULL;
+	}
+
+	block_t *block = (block_t *) (heap_base + heap_size);
+	heap_size += size;
+	write_header(block, size, false);
+
+	return coalesce_block(block);
+}
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ */
+static word_t pack(size_t size, bool alloc)
+{
+	return alloc ? (size | alloc_mask) : size;
+}
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+	return (word & size_mask);
+}
+
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the block size is at least 32).
+ */
+static size_t get_size(block_t *block)
+{
+	return extract_size(block->header);
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+	return (bool) (word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+	return extract_alloc(block->header);
+}
+
+
+/*
+ * write_header: given a block and its size and allocation status,
+ *               writes an appropriate value to the block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc)
+{
+	block->header = pack(size, alloc);
+}
+
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+	return (void *) (block->payload);
+}
+
+
+/*
+ * find_buddy: returns the buddy of a block by flipping the bit of its size
+ *             in its offset, or NULL if the buddy is not entirely inside
+ *             the heap yet.
+ */
+static block_t *find_buddy(block_t *block)
+{
+	size_t size = get_size(block);
+	size_t offset = ((unsigned char *) block - heap_base) ^ size;
+
+	if(offset + size > heap_size) return NULL;
+
+	return (block_t *) (heap_base + offset);
+}
+
+static word_t get_payload_size(block_t *block)
+{
+	size_t asize = get_size(block);
+	return asize - wsize;
+}
+
+
+/*
+ * find_order: returns the order of the smallest block that holds asize bytes
+ */
+static int find_order(size_t asize)
+{
+	int order;
+
+	if(asize <= ((size_t) 1 << min_order)) return min_order;
+
+	order = 64 - __builtin_clzll((unsigned long long) (asize - 1));
+	return order;
+}
+
+/*
+ * get_order: returns the order of a block from its size
+ */
+static int get_order(block_t *block)
+{
+	return __builtin_ctzll((unsigned long long) get_size(block));
+}
+
+// push the block on the head of the list of its order
+static void append_free_list(block_t *block) {
+	int order = get_order(block);
+
+	if(get_alloc(block)) {
+		fprintf(stderr, "Cannot add an allocated ptr to the free list\n");
+		exit(-1);
+	}
+
+	block->previous = NULL;
+	block->next = free_lists[order];
+	if(block->next != NULL) block->next->previous = block;
+	free_lists[order] = block;
+
+	order_bitmap |= (uint64_t) 1 << order;
+}
+
+// take the block out of the list of its order
+static void disconnect_block(block_t *block) {
+	int order = get_order(block);
+
+	if(block->previous != NULL) {
+		block->previous->next = block->next;
+	}else{
+		free_lists[order] = block->next;
+	}
+	if(block->next != NULL) block->next->previous = block->previous;
+
+	if(free_lists[order] == NULL) order_bitmap &= ~((uint64_t) 1 << order);
+}
@@ -58,9 +58,14 @@
 #define ALIGNMENT 8  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes. The large-heap build (make LARGE_HEAP=1)
+ * is 64-bit and only reserves the address space, see memlib.c.
  */
+#ifdef LARGE_HEAP
+#define MAX_HEAP ((size_t) 32 << 30)  /* 32 GB */
+#else
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
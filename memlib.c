@@ -2,6 +2,18 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap is MAX_HEAP bytes of reserved, inaccessible address
+ *            space. Pages are committed, made readable and writable, as
+ *            mem_sbrk moves the break onto them, commit_ahead bytes at a
+ *            time so that not every mem_sbrk costs a system call.
+ *
+ *            With mem_set_huge_pages, the heap is backed by huge pages:
+ *            from the hugetlb pool if it holds the initial commit,
+ *            otherwise by transparent huge pages (MADV_HUGEPAGE), which
+ *            also take over if the pool runs dry later. The heap then
+ *            starts on a huge page boundary and is committed in whole huge
+ *            pages.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,24 +26,86 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Bytes committed at a time, a multiple of the page size */
+static const size_t commit_ahead = (1 << 20);
+
+/* Size of a huge page, a divisor of MAX_HEAP */
+#define HUGE_PAGE_SIZE (2 << 20)
+
+/* 
+ * How newly committed pages are faulted in: 0 on first touch by the
+ * allocator, 1 by the kernel while committing (MAP_POPULATE), 2 by
+ * touching every page while committing
+ */
+static const int prefault = 1;
+
+/* 
+ * Bytes mem_init commits and faults in up front, so that a heap of this
+ * size never page-faults in a timed run
+ */
+static const size_t commit_initial = (20 << 20);
+
+/* 
+ * Give the committed pages back on every mem_reset_brk, so that every
+ * run pays for faulting its heap in. Otherwise later runs reuse them.
+ */
+static const int decommit_on_reset = 0;
+
+/* 
+ * Committed bytes a shrinking heap keeps above its break, on top of the
+ * commit_initial bytes it always keeps, so that a heap trimmed and grown
+ * again by a few megabytes does not pay for recommitting and faulting
+ */
+static const size_t decommit_slack = (8 << 20);
+
+/* 
+ * Purged pages are released with MADV_DONTNEED, which drops them at
+ * once, or with MADV_FREE, which lets the kernel drop them only when it
+ * needs the memory. Both read back as zeros once dropped.
+ */
+static const int purge_lazy = 0;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit_end; /* end of the committed pages */
+static char *mem_peak_brk;   /* highest break since the heap was reset */
+static int mem_huge;         /* 0 small pages, 1 hugetlb, 2 transparent */
+static int mem_keep_mapped;  /* a shrink only purges, see mem_set_keep_mapped */
+static char *mem_purge_end;  /* end of the pages a kept shrink may purge */
+
+static int mem_commit(char *end);
+static int mem_decommit(char *end);
+static size_t mem_commit_step(void);
+static void *mem_reserve(void);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * reserve the storage we will use to model the available VM. Pages
+     * are only backed once committed and touched, so MAX_HEAP may exceed
+     * physical memory.
+     */
+    if ((mem_start_brk = mem_reserve()) == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak_brk = mem_start_brk;
+    mem_commit_end = mem_start_brk;           /* nothing committed yet */
+    mem_purge_end = mem_start_brk;
+
+    if (mem_commit(mem_start_brk + (commit_initial < MAX_HEAP ?
+                                    commit_initial : MAX_HEAP)) < 0) {
+	fprintf(stderr, "mem_init_vm: commit error\n");
+	exit(1);
+    }
 }
 
 /* 
@@ -39,7 +113,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
@@ -48,23 +122,61 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
+
+    if (decommit_on_reset && mem_decommit(mem_start_brk) < 0) {
+	fprintf(stderr, "mem_reset_brk: mmap error\n");
+	exit(1);
+    }
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, and the committed pages more than
+ *    decommit_slack above the new break are given back, or only purged
+ *    if they must stay mapped.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
     char *old_brk = mem_brk;
+    size_t keep;
+
+    if (incr < 0) {
+	if (-incr > mem_brk - mem_start_brk) {
+		errno = EINVAL;
+		fprintf(stderr, "ERROR: mem_sbrk failed. Heap would shrink below its start...\n");
+		return (void *)-1;
+	}
+	mem_brk += incr;
+	keep = mem_heapsize() + decommit_slack;
+	if (keep < commit_initial)
+	    keep = commit_initial;
+	if (keep < MAX_HEAP && !mem_keep_mapped) {
+	    mem_decommit(mem_start_brk + keep);
+	}
+	else if (keep < (size_t)(mem_purge_end - mem_start_brk)) {
+	    mem_purge(mem_start_brk + keep, mem_purge_end - mem_start_brk - keep);
+	    mem_purge_end = mem_start_brk + keep;
+	}
+	return (void *)old_brk;
+    }
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if (incr > mem_max_addr - mem_brk) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
     }
+    if ((mem_brk + incr > mem_commit_end) && (mem_commit(mem_brk + incr) < 0)) {
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+		return (void *)-1;
+    }
     mem_brk += incr;
+    if (mem_brk > mem_peak_brk)
+	mem_peak_brk = mem_brk;
+    if (mem_brk > mem_purge_end)
+	mem_purge_end = mem_brk;
     return (void *)old_brk;
 }
 
@@ -92,6 +204,60 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since the
+ *    heap was last reset
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
+/*
+ * mem_committed() - returns the bytes of the heap that are committed
+ */
+size_t mem_committed()
+{
+    return (size_t)(mem_commit_end - mem_start_brk);
+}
+
+/*
+ * mem_reserved() - returns the bytes of address space reserved for the heap
+ */
+size_t mem_reserved()
+{
+    return (size_t)(mem_max_addr - mem_start_brk);
+}
+
+/*
+ * mem_set_huge_pages() - back the heap with huge pages, or not. Takes
+ *    effect at the next mem_init.
+ */
+void mem_set_huge_pages(int enable)
+{
+    mem_huge = enable ? 1 : 0;
+}
+
+/*
+ * mem_set_keep_mapped() - keep the pages a shrinking heap gives back
+ *    mapped and readable, so that a lock-free front end may still read
+ *    a stale link from a block that was trimmed away. Their contents are
+ *    dropped all the same.
+ */
+void mem_set_keep_mapped(int enable)
+{
+    mem_keep_mapped = enable;
+}
+
+/*
+ * mem_hugepagesize() - returns the size of the huge pages backing the
+ *    heap, or 0 if it is on small pages
+ */
+size_t mem_hugepagesize()
+{
+    return mem_huge ? HUGE_PAGE_SIZE : 0;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -99,3 +265,154 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_purge - gives the whole pages in [start, start + size) back to the
+ *    system, keeping the address range. Returns the bytes released.
+ */
+size_t mem_purge(void *start, size_t size)
+{
+    size_t page = mem_hugepagesize() ? mem_hugepagesize() : mem_pagesize();
+    uintptr_t lo = ((uintptr_t)start + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t hi = ((uintptr_t)start + size) & ~(uintptr_t)(page - 1);
+    int advice = MADV_DONTNEED;
+
+#ifdef MADV_FREE
+    if (purge_lazy)
+	advice = MADV_FREE;
+#endif
+
+    if (hi <= lo || madvise((void *)lo, hi - lo, advice) < 0)
+	return 0;
+    return hi - lo;
+}
+
+/*
+ * mem_commit - commits the heap up to at least end, rounded up to a
+ *    multiple of commit_ahead or of a huge page, and faults the new pages
+ *    in as prefault says
+ */
+static int mem_commit(char *end)
+{
+    size_t step = mem_commit_step();
+    size_t size = (end - mem_start_brk + step - 1) / step * step;
+    char *new_end = mem_start_brk + (size < MAX_HEAP ? size : MAX_HEAP);
+    char *p;
+
+    if (new_end <= mem_commit_end)
+	return 0;
+
+    if (mem_huge == 1) {
+	/* the pages come from the hugetlb pool, which may run dry */
+	if (mmap(mem_commit_end, new_end - mem_commit_end, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB |
+	         (prefault ? MAP_POPULATE : 0), -1, 0) != MAP_FAILED) {
+	    mem_commit_end = new_end;
+	    mem_purge_end = new_end;
+	    return 0;
+	}
+
+	/* then the rest of the heap goes on transparent huge pages */
+	if (mmap(mem_commit_end, mem_max_addr - mem_commit_end, PROT_NONE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+	         -1, 0) == MAP_FAILED)
+	    return -1;
+	madvise(mem_commit_end, mem_max_addr - mem_commit_end, MADV_HUGEPAGE);
+	mem_huge = 2;
+    }
+
+    if (prefault == 1 && mem_huge == 0) {
+	/* map committed pages over the reserved ones, populated */
+	if (mmap(mem_commit_end, new_end - mem_commit_end, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_POPULATE,
+	         -1, 0) == MAP_FAILED)
+	    return -1;
+    }
+    else if (mprotect(mem_commit_end, new_end - mem_commit_end,
+                      PROT_READ | PROT_WRITE) < 0) {
+	return -1;
+    }
+
+    /* a new mapping would drop MADV_HUGEPAGE, so touch the pages instead */
+    if (prefault == 2 || (prefault == 1 && mem_huge == 2)) {
+	for (p = mem_commit_end; p < new_end; p += getpagesize())
+	    *(volatile char *)p = 0;
+    }
+
+    mem_commit_end = new_end;
+    mem_purge_end = new_end;
+    return 0;
+}
+
+/*
+ * mem_decommit - gives back the committed pages from end, rounded up to
+ *    a commit step, on. They become reserved address space again.
+ */
+static int mem_decommit(char *end)
+{
+    size_t step = mem_commit_step();
+    char *new_end = mem_start_brk + (end - mem_start_brk + step - 1) / step * step;
+
+    if (new_end >= mem_commit_end)
+	return 0;
+
+    if (mmap(new_end, mem_commit_end - new_end, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+             -1, 0) == MAP_FAILED)
+	return -1;
+    if (mem_huge == 2)
+	madvise(new_end, mem_commit_end - new_end, MADV_HUGEPAGE);
+
+    mem_commit_end = new_end;
+    return 0;
+}
+
+/*
+ * mem_commit_step - the heap is committed in multiples of this size
+ */
+static size_t mem_commit_step(void)
+{
+    return mem_huge && commit_ahead < HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : commit_ahead;
+}
+
+/*
+ * mem_reserve - reserves MAX_HEAP bytes of address space for the heap.
+ *    For huge pages, the heap is aligned to a huge page and mem_huge set
+ *    to the kind the system has.
+ */
+static void *mem_reserve(void)
+{
+    char *start, *probe;
+    size_t initial = commit_initial < MAX_HEAP ? commit_initial : MAX_HEAP;
+
+    if (!mem_huge)
+	return mmap(NULL, MAX_HEAP, PROT_NONE,
+	            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    /* over-reserve by a huge page and trim both ends to align the heap */
+    start = mmap(NULL, MAX_HEAP + HUGE_PAGE_SIZE, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED)
+	return MAP_FAILED;
+
+    size_t head = -(uintptr_t) start & (HUGE_PAGE_SIZE - 1);
+    if (head > 0)
+	munmap(start, head);
+    munmap(start + head + MAX_HEAP, HUGE_PAGE_SIZE - head);
+    start += head;
+
+    /* use the hugetlb pool if it holds the initial commit */
+    initial = (initial + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    probe = mmap(NULL, initial, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (probe != MAP_FAILED) {
+	munmap(probe, initial);
+	mem_huge = 1;
+    }
+    else {
+	madvise(start, MAX_HEAP, MADV_HUGEPAGE);
+	mem_huge = 2;
+    }
+
+    return start;
+}
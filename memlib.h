@@ -1,11 +1,19 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_committed(void);
+size_t mem_reserved(void);
 size_t mem_pagesize(void);
+size_t mem_hugepagesize(void);
+void mem_set_huge_pages(int enable);
+void mem_set_keep_mapped(int enable);
+size_t mem_purge(void *start, size_t size);
 
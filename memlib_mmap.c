@@ -0,0 +1,247 @@
+/*
+ * memlib_mmap.c - the memory system of memlib.c on real memory, for
+ *            running the allocators as the malloc of a process. The heap
+ *            is either one mapping of MAX_HEAP bytes, whose pages the
+ *            kernel only backs when first touched, or the process break
+ *            itself. Nothing here may call malloc, since this is below it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+
+#include "memlib.h"
+#include "config.h"
+
+/* Use sbrk instead of a mapping. The break must then belong to us alone. */
+static const int use_brk = 0;
+
+/* 
+ * Purged pages are released with MADV_DONTNEED, which drops them at
+ * once, or with MADV_FREE, which lets the kernel drop them only when it
+ * needs the memory. Both read back as zeros once dropped.
+ */
+static const int purge_lazy = 0;
+
+/* private variables */
+static char *mem_start_brk;  /* points to first byte of heap */
+static char *mem_brk;        /* points to last byte of heap */
+static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_peak_brk;   /* highest break since the heap was reset */
+static char *mem_sys_brk;    /* the system break, above mem_brk after a kept shrink */
+static int mem_keep_mapped;  /* a shrink only purges, see mem_set_keep_mapped */
+
+static void mem_error(const char *msg);
+
+/*
+ * mem_init - map the heap, or start it at the current break rounded up
+ *    to the heap alignment
+ */
+void mem_init(void)
+{
+    if (use_brk) {
+        char *brk = sbrk(0);
+        intptr_t pad = -(intptr_t) brk & 15;
+
+        if (brk == (char *) -1 || sbrk(pad) == (void *) -1) {
+            mem_error("mem_init: sbrk error\n");
+            exit(1);
+        }
+        mem_start_brk = brk + pad;
+    }
+    else {
+        /* libmm.so is built with LARGE_HEAP, so this only reserves the
+           address space a real program may grow into */
+        mem_start_brk = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem_start_brk == MAP_FAILED) {
+            mem_error("mem_init: mmap error\n");
+            exit(1);
+        }
+    }
+
+    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_peak_brk = mem_start_brk;
+    mem_sys_brk = mem_start_brk;
+}
+
+/*
+ * mem_deinit - give the heap back to the system
+ */
+void mem_deinit(void)
+{
+    if (use_brk)
+        brk(mem_start_brk);
+    else
+        munmap(mem_start_brk, MAX_HEAP);
+}
+
+/*
+ * mem_reset_brk - reset the brk pointer to make an empty heap
+ */
+void mem_reset_brk()
+{
+    if (use_brk)
+        brk(mem_start_brk);
+    mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
+    mem_sys_brk = mem_start_brk;
+}
+
+/*
+ * mem_sbrk - extends the heap by incr bytes and returns the start address
+ *    of the new area. A negative incr shrinks the heap, giving the whole
+ *    pages above the new break back. On the break, fails if someone else
+ *    moved it, as the heap would no longer be contiguous, and only lowers
+ *    it if the pages need not stay mapped.
+ */
+void *mem_sbrk(intptr_t incr)
+{
+    char *old_brk = mem_brk;
+
+    if (incr < 0 && -incr > mem_brk - mem_start_brk) {
+        errno = EINVAL;
+        mem_error("ERROR: mem_sbrk failed. Heap would shrink below its start...\n");
+        return (void *)-1;
+    }
+
+    if (incr > mem_max_addr - mem_brk) {
+        errno = ENOMEM;
+        mem_error("ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *)-1;
+    }
+
+    if (use_brk && sbrk(0) != mem_sys_brk) {
+        errno = ENOMEM;
+        mem_error("ERROR: mem_sbrk failed. The break was moved...\n");
+        return (void *)-1;
+    }
+
+    if (use_brk && (incr > mem_sys_brk - mem_brk || (incr < 0 && !mem_keep_mapped))) {
+        if (sbrk(mem_brk + incr - mem_sys_brk) == (void *)-1) {
+            mem_error("ERROR: mem_sbrk failed. Ran out of memory...\n");
+            return (void *)-1;
+        }
+        mem_sys_brk = mem_brk + incr;
+    }
+    else if (incr < 0) {
+        mem_purge(mem_brk + incr, -incr);
+    }
+
+    mem_brk += incr;
+    if (mem_brk > mem_peak_brk)
+        mem_peak_brk = mem_brk;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo()
+{
+    return (void *)mem_start_brk;
+}
+
+/*
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi()
+{
+    return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize()
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since the
+ *    heap was last reset
+ */
+size_t mem_peak_heapsize()
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
+/*
+ * mem_committed() - returns the bytes of the heap that are committed. The
+ *    whole mapping is, the kernel backs its pages when first touched.
+ */
+size_t mem_committed()
+{
+    return use_brk ? (size_t)(mem_sys_brk - mem_start_brk) : MAX_HEAP;
+}
+
+/*
+ * mem_reserved() - returns the bytes of address space reserved for the heap
+ */
+size_t mem_reserved()
+{
+    return use_brk ? (size_t)(mem_sys_brk - mem_start_brk) : MAX_HEAP;
+}
+
+/*
+ * mem_set_keep_mapped() - keep the pages a shrinking heap gives back
+ *    mapped and readable, so that a lock-free front end may still read
+ *    a stale link from a block that was trimmed away. Their contents are
+ *    dropped all the same.
+ */
+void mem_set_keep_mapped(int enable)
+{
+    mem_keep_mapped = enable;
+}
+
+/*
+ * mem_hugepagesize() - the heap is on small pages, unless the kernel
+ *    backs the mapping with transparent huge pages on its own
+ */
+size_t mem_hugepagesize()
+{
+    return 0;
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize()
+{
+    return (size_t)getpagesize();
+}
+
+/*
+ * mem_purge - gives the whole pages in [start, start + size) back to the
+ *    system, keeping the address range. Returns the bytes released.
+ */
+size_t mem_purge(void *start, size_t size)
+{
+    size_t page = mem_pagesize();
+    uintptr_t lo = ((uintptr_t)start + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t hi = ((uintptr_t)start + size) & ~(uintptr_t)(page - 1);
+    int advice = MADV_DONTNEED;
+
+#ifdef MADV_FREE
+    if (purge_lazy)
+        advice = MADV_FREE;
+#endif
+
+    if (hi <= lo || madvise((void *)lo, hi - lo, advice) < 0)
+        return 0;
+    return hi - lo;
+}
+
+/*
+ * mem_error - print msg without stdio, which may allocate
+ */
+static void mem_error(const char *msg)
+{
+    ssize_t ignored = write(STDERR_FILENO, msg, strlen(msg));
+    (void) ignored;
+}
@@ -4,6 +4,7 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
 
 
 /* 
@@ -0,0 +1,409 @@
+/*
+ ******************************************************************************
+ *                                mm_async.c                                  *
+ *         Asynchronous free front end for the malloc lab allocators          *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *  mm_free only queues the pointer on a bounded ring and returns, so the     *
+ *  calling thread never pays for coalescing and relinking. A background      *
+ *  thread takes the queued pointers in batches, sorts every batch by         *
+ *  address and frees it in one pass under the engine lock, so neighbors in   *
+ *  a batch are merged once. The engine is one of the *_mm.c engines, renamed *
+ *  to engine_* (see ENGINE_RENAME in the Makefile). If it has a batch free,  *
+ *  that does the merging, otherwise the batch is freed one block at a time   *
+ *  in address order. A producer that finds the ring full wakes the           *
+ *  background thread and waits for room.                                     *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Entry points of the engine */
+extern int engine_init(void);
+extern void *engine_malloc(size_t size);
+extern void engine_free(void *ptr);
+extern void *engine_realloc(void *ptr, size_t size);
+extern size_t engine_usable_size(void *ptr);
+
+// Only some engines free a sorted batch in one pass
+extern void engine_free_batch(void **ptrs, int count) __attribute__((weak));
+
+// Only some engines give the free top of the heap back
+extern int engine_trim(size_t pad) __attribute__((weak));
+extern void engine_auto_trim(bool enable) __attribute__((weak));
+
+/* Basic constants */
+
+// Slots of the ring, a power of two
+#define ASYNC_RING 4096
+
+// Most pointers the background thread frees under one lock hold
+#define ASYNC_BATCH 256
+
+/*
+  Queued frees beyond which a malloc, which holds the engine lock anyway,
+  frees a batch itself before allocating, so a lagging background thread
+  cannot make the heap grow without bound
+*/
+static const unsigned long async_lag = 2 * ASYNC_BATCH;
+
+// Longest the background thread sleeps when the ring looks empty (ns)
+static const long async_idle_ns = 1000000;
+
+/*
+  One slot of the ring. As in a bounded multi-producer queue, seq tells
+  whose turn the slot is: a producer at position pos may fill it when
+  seq == pos, the consumer may empty it when seq == pos + 1, after which
+  it becomes seq == pos + ASYNC_RING for the producer one lap later.
+*/
+typedef struct async_slot
+{
+	unsigned long seq;
+	void *ptr;
+
+} async_slot_t;
+
+
+/* Global variables */
+
+static async_slot_t ring[ASYNC_RING];
+
+// Next position to fill, shared by all producers
+static unsigned long enqueue_pos __attribute__((aligned(64)));
+// Next position to empty, only advanced under engine_lock
+static unsigned long dequeue_pos __attribute__((aligned(64)));
+
+// Serializes every call into the engine, and the consumer side of the ring
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The background thread sleeps on wakeup while idle is set
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static int idle;
+
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+
+// Statistics, updated by the consumer except full_waits
+static size_t async_freed;
+static size_t async_batches;
+static size_t full_waits;
+
+/* Function prototypes for internal helper routines */
+
+static void start_worker(void);
+static void *worker_main(void *arg);
+static bool ring_push(void *ptr);
+static int ring_pop(void **ptrs, int count);
+static int drain_ring(void);
+static void *engine_alloc(void *ptr, size_t size);
+static void wake_worker(void);
+static int compare_address(const void *a, const void *b);
+void mm_status();
+
+
+/*
+ * Start a new heap. Whatever is still queued belongs to the old heap and
+ * is dropped. mm_init must not run while other threads use the allocator.
+ * The engine does not trim on its own here: the background thread may
+ * still be freeing while the driver resets the heap under it, and the
+ * break must not move then. mm_trim trims on request.
+ */
+int mm_init()
+{
+	int result, i;
+
+	pthread_once(&worker_once, start_worker);
+
+	pthread_mutex_lock(&engine_lock);
+	for (i = 0; i < ASYNC_RING; i++)
+		__atomic_store_n(&ring[i].seq, i, __ATOMIC_RELAXED);
+	__atomic_store_n(&enqueue_pos, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dequeue_pos, 0, __ATOMIC_RELEASE);
+	async_freed = async_batches = full_waits = 0;
+	if (engine_auto_trim)
+		engine_auto_trim(false);
+	result = engine_init();
+	pthread_mutex_unlock(&engine_lock);
+
+	return result;
+}
+
+/* Allocate from the engine */
+void *mm_malloc(size_t size)
+{
+	void *bp;
+
+	pthread_mutex_lock(&engine_lock);
+	bp = engine_alloc(NULL, size);
+	pthread_mutex_unlock(&engine_lock);
+
+	return bp;
+}
+
+/*
+ * Queue the block for the background thread. While the ring is full the
+ * caller waits, yielding the CPU to the background thread.
+ */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	if (ring_push(bp))
+		return;
+
+	__atomic_fetch_add(&full_waits, 1, __ATOMIC_RELAXED);
+	do {
+		wake_worker();
+		sched_yield();
+	} while (!ring_push(bp));
+}
+
+/*
+ * A queued block is still allocated as far as the engine is concerned, so
+ * realloc goes to the engine directly, the same way as malloc
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+	void *newptr;
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+		return mm_malloc(size);
+
+	// If size == 0, then free block and return NULL
+	if (size == 0) {
+		mm_free(ptr);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&engine_lock);
+	newptr = engine_alloc(ptr, size);
+	pthread_mutex_unlock(&engine_lock);
+
+	return newptr;
+}
+
+size_t mm_usable_size(void *ptr)
+{
+	return engine_usable_size(ptr);
+}
+
+/*
+ * Give the free top of the engine's heap back, from the calling thread.
+ * Queued blocks are still allocated and stay put. Returns 0 if the engine
+ * cannot trim.
+ */
+int mm_trim(size_t pad)
+{
+	int result;
+
+	if (!engine_trim)
+		return 0;
+
+	pthread_mutex_lock(&engine_lock);
+	result = engine_trim(pad);
+	pthread_mutex_unlock(&engine_lock);
+
+	return result;
+}
+
+/* Print how much the background thread freed and how often the ring was full */
+void mm_status() {
+	printf("The status of the free ring\n");
+	printf("*******************************\n");
+	printf("freed = %zu in %zu batches, full waits = %zu, queued = %lu\n",
+	       async_freed, async_batches, full_waits,
+	       __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED) -
+	       __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED));
+	printf("*******************************\n");
+}
+
+/******** The remaining content below are helper routines ********/
+
+
+static void start_worker(void)
+{
+	pthread_t worker;
+
+	if (pthread_create(&worker, NULL, worker_main, NULL) != 0) {
+		fprintf(stderr, "Could not start the free thread\n");
+		exit(1);
+	}
+	pthread_detach(worker);
+}
+
+/*
+ * worker_main: the background thread. Frees a batch whenever there is one,
+ *              otherwise sleeps until a producer wakes it or a while passed.
+ */
+static void *worker_main(void *arg)
+{
+	(void) arg;
+
+	while (true) {
+		pthread_mutex_lock(&engine_lock);
+		int freed = drain_ring();
+		pthread_mutex_unlock(&engine_lock);
+
+		if (freed > 0)
+			continue;
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += async_idle_ns;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		pthread_mutex_lock(&idle_lock);
+		__atomic_store_n(&idle, 1, __ATOMIC_SEQ_CST);
+		pthread_cond_timedwait(&wakeup, &idle_lock, &deadline);
+		__atomic_store_n(&idle, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&idle_lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * drain_ring: frees one batch from the ring, sorted by address. The caller
+ *             holds engine_lock. Returns the number of blocks freed.
+ */
+static int drain_ring(void)
+{
+	void *ptrs[ASYNC_BATCH];
+	int count, i;
+
+	if ((count = ring_pop(ptrs, ASYNC_BATCH)) == 0)
+		return 0;
+
+	qsort(ptrs, count, sizeof(void *), compare_address);
+
+	if (engine_free_batch) {
+		engine_free_batch(ptrs, count);
+	}
+	else {
+		for (i = 0; i < count; i++)
+			engine_free(ptrs[i]);
+	}
+
+	async_freed += count;
+	async_batches++;
+	return count;
+}
+
+/*
+ * engine_alloc: mallocs size bytes if ptr is NULL and reallocs ptr
+ *               otherwise, helping the background thread first if it lags
+ *               behind. If the engine is out of memory, every queued free
+ *               is done right away and the request tried once more. The
+ *               caller holds engine_lock.
+ */
+static void *engine_alloc(void *ptr, size_t size)
+{
+	void *bp;
+	int freed = 0;
+
+	if (__atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED) - dequeue_pos >= async_lag)
+		drain_ring();
+
+	bp = ptr == NULL ? engine_malloc(size) : engine_realloc(ptr, size);
+	if (bp == NULL && size != 0) {
+		while (drain_ring() > 0)
+			freed = 1;
+		if (freed)
+			bp = ptr == NULL ? engine_malloc(size) : engine_realloc(ptr, size);
+	}
+
+	return bp;
+}
+
+/*
+ * ring_push: claims the next slot with a compare-and-swap and fills it.
+ *            Returns false if the ring is full.
+ */
+static bool ring_push(void *ptr)
+{
+	unsigned long pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+	while (true) {
+		async_slot_t *slot = &ring[pos % ASYNC_RING];
+		unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		long diff = (long) (seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->ptr = ptr;
+				__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+				break;
+			}
+		}
+		else if (diff < 0) {
+			return false; // the consumer is a whole lap behind
+		}
+		else {
+			pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (__atomic_load_n(&idle, __ATOMIC_SEQ_CST) &&
+	    pos - __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED) >= ASYNC_BATCH / 2)
+		wake_worker();
+	return true;
+}
+
+/*
+ * ring_pop: takes up to count filled slots in order, stopping at the first
+ *           one still being filled. The caller holds engine_lock, so there
+ *           is one consumer at a time.
+ */
+static int ring_pop(void **ptrs, int count)
+{
+	unsigned long pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+	int taken = 0;
+
+	while (taken < count) {
+		async_slot_t *slot = &ring[pos % ASYNC_RING];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+
+		ptrs[taken++] = slot->ptr;
+		__atomic_store_n(&slot->seq, pos + ASYNC_RING, __ATOMIC_RELEASE);
+		pos++;
+	}
+
+	__atomic_store_n(&dequeue_pos, pos, __ATOMIC_RELAXED);
+	return taken;
+}
+
+static void wake_worker(void)
+{
+	pthread_mutex_lock(&idle_lock);
+	pthread_cond_signal(&wakeup);
+	pthread_mutex_unlock(&idle_lock);
+}
+
+static int compare_address(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t) *(void * const *) a;
+	uintptr_t y = (uintptr_t) *(void * const *) b;
+
+	return (x > y) - (x < y);
+}
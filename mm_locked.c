@@ -0,0 +1,270 @@
+/*
+ ******************************************************************************
+ *                                mm_locked.c                                 *
+ *            Coarse-locked thread-safe mode of the malloc lab allocators     *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *  The simplest thread-safe allocator: every call into one of the *_mm.c     *
+ *  engines, compiled with its entry points renamed to engine_* (see          *
+ *  ENGINE_RENAME in the Makefile), holds a single global lock. The lock is   *
+ *  a pthread mutex, a spinlock or a ticket lock, chosen by lock_type. How    *
+ *  long every acquire waited and every hold lasted is counted in log2        *
+ *  histograms, printed by mm_status, as the reference point for the other    *
+ *  thread-safe allocators.                                                   *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Entry points of the locked allocator */
+extern int engine_init(void);
+extern void *engine_malloc(size_t size);
+extern void engine_free(void *ptr);
+extern void *engine_realloc(void *ptr, size_t size);
+extern size_t engine_usable_size(void *ptr);
+
+/* Basic constants */
+
+static const int lock_type = 0; // 0 for pthread mutex, 1 for spinlock, 2 for ticket lock
+
+// Spins of a spinlock or ticket lock waiter before it yields the CPU
+static const int spin_limit = 100;
+
+/*
+  Bucket i of a histogram counts times of [2^i, 2^(i+1)) nanoseconds,
+  bucket 0 also counts shorter ones and the last bucket everything longer
+*/
+#define HIST_BUCKETS 32
+
+typedef struct lock_hist
+{
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total_ns;
+
+} lock_hist_t;
+
+/* Global variables */
+
+static pthread_mutex_t mutex_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Spinlock word, 1 while held
+static int spin_lock;
+
+// Ticket lock: the next ticket to hand out and the ticket being served
+static unsigned ticket_next;
+static unsigned ticket_serving;
+
+/*
+  Both histograms are only updated by the lock holder, so they need no
+  atomics of their own. hold_start is when the holder got the lock.
+*/
+static lock_hist_t wait_hist;
+static lock_hist_t hold_hist;
+static uint64_t hold_start;
+
+/* Function prototypes for internal helper routines */
+
+static void global_lock_acquire(void);
+static void global_lock_release(void);
+static void cpu_relax(int *spins);
+static uint64_t now_ns(void);
+static void hist_add(lock_hist_t *hist, uint64_t ns);
+static void hist_print(const char *name, lock_hist_t *hist);
+void mm_status();
+
+
+/*
+ * Start a new heap and new lock histograms. mm_init must not run while
+ * other threads use the allocator.
+ */
+int mm_init()
+{
+	int result;
+
+	global_lock_acquire();
+	result = engine_init();
+	memset(&wait_hist, 0, sizeof(wait_hist));
+	memset(&hold_hist, 0, sizeof(hold_hist));
+	global_lock_release();
+
+	return result;
+}
+
+void *mm_malloc(size_t size)
+{
+	void *bp;
+
+	global_lock_acquire();
+	bp = engine_malloc(size);
+	global_lock_release();
+
+	return bp;
+}
+
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	global_lock_acquire();
+	engine_free(bp);
+	global_lock_release();
+}
+
+void *mm_realloc(void *ptr, size_t size)
+{
+	void *newptr;
+
+	global_lock_acquire();
+	newptr = engine_realloc(ptr, size);
+	global_lock_release();
+
+	return newptr;
+}
+
+/*
+ * The size of an allocated block cannot change under its owner, so this
+ * one needs no lock
+ */
+size_t mm_usable_size(void *ptr)
+{
+	return engine_usable_size(ptr);
+}
+
+/* Print the lock type and both histograms */
+void mm_status() {
+	static const char *lock_names[] = {"mutex", "spinlock", "ticket lock"};
+
+	printf("The status of the global %s\n", lock_names[lock_type]);
+	printf("*******************************\n");
+	hist_print("wait", &wait_hist);
+	hist_print("hold", &hold_hist);
+	printf("*******************************\n");
+}
+
+/******** The remaining content below are helper routines ********/
+
+
+/*
+ * global_lock_acquire: takes the global lock and records how long that took
+ */
+static void global_lock_acquire(void)
+{
+	uint64_t start = now_ns();
+	int spins = 0;
+
+	if (lock_type == 0) {
+		pthread_mutex_lock(&mutex_lock);
+	}
+	else if (lock_type == 1) {
+		// Test and test-and-set, so waiters spin on their own cached copy
+		while (__atomic_exchange_n(&spin_lock, 1, __ATOMIC_ACQUIRE)) {
+			while (__atomic_load_n(&spin_lock, __ATOMIC_RELAXED))
+				cpu_relax(&spins);
+		}
+	}
+	else {
+		unsigned ticket = __atomic_fetch_add(&ticket_next, 1, __ATOMIC_RELAXED);
+		while (__atomic_load_n(&ticket_serving, __ATOMIC_ACQUIRE) != ticket)
+			cpu_relax(&spins);
+	}
+
+	hold_start = now_ns();
+	hist_add(&wait_hist, hold_start - start);
+}
+
+/*
+ * global_lock_release: records how long the lock was held and releases it
+ */
+static void global_lock_release(void)
+{
+	hist_add(&hold_hist, now_ns() - hold_start);
+
+	if (lock_type == 0) {
+		pthread_mutex_unlock(&mutex_lock);
+	}
+	else if (lock_type == 1) {
+		__atomic_store_n(&spin_lock, 0, __ATOMIC_RELEASE);
+	}
+	else {
+		// Only the holder writes ticket_serving
+		__atomic_store_n(&ticket_serving, ticket_serving + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * cpu_relax: one spin of a waiter. After spin_limit spins the waiter
+ *            yields, so a preempted holder gets the CPU back.
+ */
+static void cpu_relax(int *spins)
+{
+	if (++*spins < spin_limit) {
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+		return;
+	}
+
+	*spins = 0;
+	sched_yield();
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void hist_add(lock_hist_t *hist, uint64_t ns)
+{
+	int bucket = 0;
+
+	while (bucket < HIST_BUCKETS - 1 && (ns >> (bucket + 1)) != 0)
+		bucket++;
+
+	hist->counts[bucket]++;
+	hist->total_ns += ns;
+}
+
+/*
+ * hist_print: prints the non-empty buckets of a histogram with the share
+ *             of all samples in each
+ */
+static void hist_print(const char *name, lock_hist_t *hist)
+{
+	uint64_t samples = 0;
+	int bucket;
+
+	for (bucket = 0; bucket < HIST_BUCKETS; bucket++)
+		samples += hist->counts[bucket];
+
+	if (samples == 0) {
+		printf("%s: no samples\n", name);
+		return;
+	}
+
+	printf("%s: %" PRIu64 " samples, mean %.1f ns\n", name, samples,
+	       (double) hist->total_ns / samples);
+	for (bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+		if (hist->counts[bucket] == 0) continue;
+
+		printf("  %12" PRIu64 " ns+ %12" PRIu64 " %6.2f%%\n",
+		       bucket == 0 ? 0 : (uint64_t) 1 << bucket, hist->counts[bucket],
+		       100.0 * hist->counts[bucket] / samples);
+	}
+}
@@ -0,0 +1,302 @@
+/*
+ ******************************************************************************
+ *                                mm_percpu.c                                 *
+ *            Per-CPU caching front end for the malloc lab allocators         *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *  Like mm_thread.c, but the caches of freed blocks belong to CPUs instead   *
+ *  of threads, so cached memory grows with the number of cores and not with  *
+ *  the number of threads. A call uses the cache of the CPU it runs on, as    *
+ *  told by sched_getcpu. A thread takes a cache by swapping its owner word   *
+ *  from free to busy, and gives it back when done. If it finds the cache     *
+ *  busy, because the thread was moved or preempted, it goes to the central   *
+ *  allocator instead of waiting, so the fast path never blocks. The central  *
+ *  allocator is one of the *_mm.c engines, renamed to engine_* (see          *
+ *  ENGINE_RENAME in the Makefile) and serialized by one lock.                *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#define _GNU_SOURCE  // for sched_getcpu
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/sysinfo.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Entry points of the central allocator */
+extern int engine_init(void);
+extern void *engine_malloc(size_t size);
+extern void engine_free(void *ptr);
+extern void *engine_realloc(void *ptr, size_t size);
+extern size_t engine_usable_size(void *ptr);
+
+/* Basic constants */
+
+/*
+  Class i of a CPU cache holds blocks with at least (i + 1) * cache_step
+  usable bytes, as in the thread cache. A freed block goes to the largest
+  class it can serve.
+*/
+#define CACHE_CLASSES 32
+static const size_t cache_step = 16;
+
+// Most blocks one class of a CPU cache holds
+#define CACHE_COUNT 32
+
+// Blocks fetched from or flushed to the engine at a time
+static const int cache_batch = 16;
+
+// At most this many caches, CPUs beyond share them modulo cpu_count
+#define MAX_CPUS 64
+
+/* The cache of one CPU, on cache lines of its own */
+typedef struct cpu_cache
+{
+	// 0 while free, 1 while a thread works on the cache
+	int busy;
+
+	int counts[CACHE_CLASSES];
+	void *blocks[CACHE_CLASSES][CACHE_COUNT];
+
+	size_t contended;  // calls that found the cache busy
+
+} __attribute__((aligned(64))) cpu_cache_t;
+
+
+/* Global variables */
+
+static cpu_cache_t cpu_caches[MAX_CPUS];
+static int cpu_count = 1;
+
+// Serializes every call into the engine
+static pthread_mutex_t central_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Function prototypes for internal helper routines */
+
+static cpu_cache_t *cache_acquire(void);
+static void cache_release(cpu_cache_t *cache);
+static void cache_refill(cpu_cache_t *cache, int class);
+static void cache_flush(cpu_cache_t *cache, int class, int count);
+static void central_lock_acquire(void);
+static void central_lock_release(void);
+void mm_status();
+
+
+/*
+ * Start a new heap with empty caches. mm_init must not run while other
+ * threads use the allocator.
+ */
+int mm_init()
+{
+	int result;
+
+	cpu_count = get_nprocs_conf();
+	if (cpu_count < 1)
+		cpu_count = 1;
+	if (cpu_count > MAX_CPUS)
+		cpu_count = MAX_CPUS;
+
+	memset(cpu_caches, 0, sizeof(cpu_caches));
+
+	central_lock_acquire();
+	result = engine_init();
+	central_lock_release();
+
+	return result;
+}
+
+/*
+ * Allocate space for payload of size bytes, from the cache of this CPU
+ * when the size is small enough and the cache is free
+ */
+void *mm_malloc(size_t size)
+{
+	void *bp;
+
+	if (size == 0) // Ignore spurious request
+		return NULL;
+
+	if (size <= CACHE_CLASSES * cache_step) {
+		int class = (size - 1) / cache_step;
+		cpu_cache_t *cache = cache_acquire();
+
+		if (cache != NULL) {
+			bp = NULL;
+			if (cache->counts[class] == 0)
+				cache_refill(cache, class);
+			if (cache->counts[class] > 0)
+				bp = cache->blocks[class][--cache->counts[class]];
+			cache_release(cache);
+
+			if (bp != NULL)
+				return bp;
+		}
+	}
+
+	central_lock_acquire();
+	bp = engine_malloc(size);
+	central_lock_release();
+
+	return bp;
+}
+
+/*
+ * Free a block into the cache of this CPU, flushing a batch of its class
+ * to the engine when the class is full
+ */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	size_t usable = engine_usable_size(bp);
+
+	if (usable >= cache_step && usable < (CACHE_CLASSES + 1) * cache_step) {
+		int class = usable / cache_step - 1;
+		cpu_cache_t *cache = cache_acquire();
+
+		if (cache != NULL) {
+			if (cache->counts[class] == CACHE_COUNT)
+				cache_flush(cache, class, cache_batch);
+			cache->blocks[class][cache->counts[class]++] = bp;
+			cache_release(cache);
+			return;
+		}
+	}
+
+	central_lock_acquire();
+	engine_free(bp);
+	central_lock_release();
+}
+
+/*
+ * Cached blocks are allocated as far as the engine is concerned, so any
+ * block can be handed to the engine's realloc
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+	void *newptr;
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+		return mm_malloc(size);
+
+	// If size == 0, then free block and return NULL
+	if (size == 0) {
+		mm_free(ptr);
+		return NULL;
+	}
+
+	central_lock_acquire();
+	newptr = engine_realloc(ptr, size);
+	central_lock_release();
+
+	return newptr;
+}
+
+size_t mm_usable_size(void *ptr)
+{
+	return engine_usable_size(ptr);
+}
+
+/* Print how many blocks every CPU cache holds and how often it was busy */
+void mm_status() {
+	int cpu, class;
+
+	printf("The status of %d CPU caches\n", cpu_count);
+	printf("*******************************\n");
+	for (cpu = 0; cpu < cpu_count; cpu++) {
+		cpu_cache_t *cache = &cpu_caches[cpu];
+		size_t cached = 0;
+
+		for (class = 0; class < CACHE_CLASSES; class++)
+			cached += cache->counts[class];
+
+		printf("CPU %d: cached blocks = %zu, contended = %zu\n",
+		       cpu, cached, cache->contended);
+	}
+	printf("*******************************\n");
+}
+
+/******** The remaining content below are helper routines ********/
+
+
+/*
+ * cache_acquire: takes the cache of the CPU the caller runs on. Returns
+ *                NULL without waiting if another thread has it.
+ */
+static cpu_cache_t *cache_acquire(void)
+{
+	int cpu = sched_getcpu();
+	int expected = 0;
+
+	if (cpu < 0)
+		cpu = 0;
+
+	cpu_cache_t *cache = &cpu_caches[cpu % cpu_count];
+
+	if (__atomic_compare_exchange_n(&cache->busy, &expected, 1, false,
+	                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return cache;
+
+	__atomic_fetch_add(&cache->contended, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static void cache_release(cpu_cache_t *cache)
+{
+	__atomic_store_n(&cache->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * cache_refill: fetches a batch of blocks for an empty class under a
+ *               single lock hold
+ */
+static void cache_refill(cpu_cache_t *cache, int class)
+{
+	size_t size = (class + 1) * cache_step;
+	int i;
+
+	central_lock_acquire();
+	for (i = 0; i < cache_batch; i++) {
+		void *bp = engine_malloc(size);
+		if (bp == NULL)
+			break;
+
+		cache->blocks[class][cache->counts[class]++] = bp;
+	}
+	central_lock_release();
+}
+
+/*
+ * cache_flush: frees count blocks of a class to the engine under a
+ *              single lock hold
+ */
+static void cache_flush(cpu_cache_t *cache, int class, int count)
+{
+	central_lock_acquire();
+	while (count-- > 0 && cache->counts[class] > 0) {
+		engine_free(cache->blocks[class][--cache->counts[class]]);
+	}
+	central_lock_release();
+}
+
+static void central_lock_acquire(void)
+{
+	pthread_mutex_lock(&central_lock);
+}
+
+static void central_lock_release(void)
+{
+	pthread_mutex_unlock(&central_lock);
+}
@@ -0,0 +1,186 @@
+/*
+ * mm_preload.c - the malloc of a process on one of the malloc lab
+ *     allocators, for libmm.so. Run an unmodified program on it with
+ *
+ *         LD_PRELOAD=./libmm.so <program>
+ *
+ * The heap is set up by the first call. The allocator behind it must be
+ * thread-safe (see PRELOAD in the Makefile), this file adds no locking.
+ * Pointers outside the heap, such as blocks the dynamic loader allocated
+ * before libmm.so took over, are never freed. Alignments above ALIGN
+ * need an allocator with mm_memalign.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Every block is aligned to this many bytes */
+#define ALIGN 16
+
+/* Not every allocator has one */
+extern void *mm_memalign(size_t alignment, size_t size) __attribute__((weak));
+extern int mm_trim(size_t pad) __attribute__((weak));
+
+static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+
+static void heap_init(void);
+static int in_heap(void *ptr);
+static void *aligned(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    pthread_once(&heap_once, heap_init);
+
+    /* Every malloc(0) gets a block of its own, as with libc */
+    if ((p = mm_malloc(size ? size : 1)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || !in_heap(ptr))
+        return;
+    mm_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Freed blocks are reused, so the memory is not known to be zero */
+    if ((p = malloc(nmemb * size)) != NULL)
+        memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+
+    if (!in_heap(ptr)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+
+    if ((p = mm_realloc(ptr, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    if ((p = aligned(alignment, size)) == NULL)
+        return ENOMEM;
+
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((p = aligned(alignment, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned_alloc(mem_pagesize(), size);
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL || !in_heap(ptr))
+        return 0;
+    return mm_usable_size(ptr);
+}
+
+int malloc_trim(size_t pad)
+{
+    if (!mm_trim)
+        return 0;
+
+    pthread_once(&heap_once, heap_init);
+    return mm_trim(pad);
+}
+
+/*
+ * heap_init - set up the heap and the allocator, once per process
+ */
+static void heap_init(void)
+{
+    mem_init();
+    if (mm_init() < 0) {
+        static const char msg[] = "libmm: mm_init failed\n";
+        ssize_t ignored = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        (void) ignored;
+        abort();
+    }
+}
+
+/*
+ * in_heap - returns true if ptr lies in the heap of the allocator
+ */
+static int in_heap(void *ptr)
+{
+    pthread_once(&heap_once, heap_init);
+
+    return (char *) ptr >= (char *) mem_heap_lo() &&
+           (char *) ptr <= (char *) mem_heap_hi();
+}
+
+/*
+ * aligned - allocate size bytes aligned to alignment, a power of two
+ */
+static void *aligned(size_t alignment, size_t size)
+{
+    pthread_once(&heap_once, heap_init);
+
+    if (alignment <= ALIGN)
+        return mm_malloc(size ? size : 1);
+
+    if (!mm_memalign)
+        return NULL;
+
+    return mm_memalign(alignment, size ? size : 1);
+}
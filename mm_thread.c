@@ -0,0 +1,476 @@
+/*
+ ******************************************************************************
+ *                                mm_thread.c                                 *
+ *          Thread-caching front end for the malloc lab allocators            *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *  Every thread keeps a small cache of freed blocks per size class, so most  *
+ *  mm_malloc and mm_free calls finish without touching shared state. The     *
+ *  central allocator behind it is one of the *_mm.c engines, compiled with   *
+ *  its entry points renamed to engine_* (see ENGINE_RENAME in the Makefile)  *
+ *  and serialized by one lock. Caches are refilled from and flushed to the   *
+ *  engine in batches, and flushed for good when their thread exits.          *
+ *  Between the caches and the engine sits a depot of whole batches per       *
+ *  class, lock-free stacks that pass batches from thread to thread without   *
+ *  taking the lock. Stack heads carry a generation tag against ABA.          *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Entry points of the central allocator */
+extern int engine_init(void);
+extern void *engine_malloc(size_t size);
+extern void engine_free(void *ptr);
+extern void *engine_realloc(void *ptr, size_t size);
+extern size_t engine_usable_size(void *ptr);
+
+// Only some engines allocate with a larger alignment
+extern void *engine_memalign(size_t alignment, size_t size) __attribute__((weak));
+
+// Only some engines give the free top of the heap back
+extern int engine_trim(size_t pad) __attribute__((weak));
+
+/* Basic constants */
+
+/*
+  Class i of a thread cache holds blocks with at least (i + 1) * tcache_step
+  usable bytes, so requests of up to TCACHE_CLASSES * tcache_step bytes
+  are served from the cache. A freed block goes to the largest class it
+  can serve.
+*/
+#define TCACHE_CLASSES 32
+static const size_t tcache_step = 16;
+
+// Most blocks one class of a cache holds before half of them are flushed
+static const int tcache_count = 16;
+
+// Blocks fetched from the engine when a class runs empty
+static const int tcache_batch = 8;
+
+// Most batches the depot keeps per class before flushes go to the engine
+static const int depot_max_batches = 64;
+
+/*
+  A depot stack head is one 64-bit word, a generation tag in the high half
+  and a reference to the first block of the top batch in the low half.
+  The reference is the block's offset from the heap start in units of
+  1 << depot_ref_shift bytes, plus one, so that 0 is the empty stack.
+  Every successful push or pop bumps the tag, so a compare-and-swap with
+  a stale head always fails, even if the same batch is on top again.
+*/
+static const int depot_ref_shift = 4;
+
+/*
+  A cached block, linked through the first word of its payload. The first
+  block of a batch in the depot also links the batch below it and holds
+  the number of blocks in its batch. Every block has room for these, as
+  it has at least tcache_step usable bytes.
+*/
+typedef struct tcache_entry
+{
+	struct tcache_entry *next;
+
+	uint32_t next_batch;
+	uint32_t count;
+
+} tcache_entry_t;
+
+typedef struct tcache
+{
+	tcache_entry_t *entries[TCACHE_CLASSES];
+	int counts[TCACHE_CLASSES];
+
+	// Cache contents are only valid while this matches tcache_generation
+	unsigned generation;
+
+} tcache_t;
+
+
+/* Global variables */
+
+// The cache of the calling thread, zeroed when the thread starts
+static __thread tcache_t tcache;
+
+// Serializes every call into the engine
+static pthread_mutex_t central_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Runs tcache_thread_exit for every thread that used its cache
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+/*
+  Bumped by every mm_init, which starts a new heap. A cache of an older
+  generation holds blocks of a heap that is gone and is dropped, not
+  flushed. mm_init must not run while other threads use the allocator.
+*/
+static unsigned tcache_generation = 1;
+
+// The depot, one stack of batches and its approximate depth per class
+static uint64_t depot[TCACHE_CLASSES];
+static int depot_batches[TCACHE_CLASSES];
+
+/* Function prototypes for internal helper routines */
+
+static tcache_t *get_tcache(void);
+static void tcache_create_key(void);
+static void tcache_thread_exit(void *arg);
+static bool tcache_refill(tcache_t *tc, int class);
+static void tcache_flush(tcache_t *tc, int class, int count);
+static bool depot_push(int class, tcache_entry_t *batch);
+static tcache_entry_t *depot_pop(int class);
+static uint32_t depot_ref(tcache_entry_t *entry);
+static tcache_entry_t *depot_entry(uint32_t ref);
+static void central_lock_acquire(void);
+static void central_lock_release(void);
+
+
+/*
+ * Start a new heap. Every thread cache becomes stale.
+ */
+int mm_init()
+{
+	int result;
+
+	// A depot pop may read a link from a batch the engine has trimmed away
+	mem_set_keep_mapped(1);
+
+	central_lock_acquire();
+	tcache_generation++;
+	memset(depot, 0, sizeof(depot));
+	memset(depot_batches, 0, sizeof(depot_batches));
+	result = engine_init();
+	central_lock_release();
+
+	return result;
+}
+
+/*
+ * Allocate space for payload of size bytes, from the thread cache when
+ * the size is small enough
+ */
+void *mm_malloc(size_t size)
+{
+	void *bp;
+
+	if (size == 0) // Ignore spurious request
+		return NULL;
+
+	if (size <= TCACHE_CLASSES * tcache_step) {
+		tcache_t *tc = get_tcache();
+		int class = (size - 1) / tcache_step;
+
+		if (tc->entries[class] != NULL || tcache_refill(tc, class)) {
+			tcache_entry_t *entry = tc->entries[class];
+			tc->entries[class] = entry->next;
+			tc->counts[class]--;
+			return entry;
+		}
+	}
+
+	central_lock_acquire();
+	bp = engine_malloc(size);
+	central_lock_release();
+
+	return bp;
+}
+
+/*
+ * Free a block into the thread cache of its class, flushing half of the
+ * class to the engine when it is full
+ */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	size_t usable = engine_usable_size(bp);
+
+	if (usable >= tcache_step && usable < (TCACHE_CLASSES + 1) * tcache_step) {
+		tcache_t *tc = get_tcache();
+		int class = usable / tcache_step - 1;
+		tcache_entry_t *entry = bp;
+
+		entry->next = tc->entries[class];
+		tc->entries[class] = entry;
+		tc->counts[class]++;
+
+		if (tc->counts[class] > tcache_count)
+			tcache_flush(tc, class, tcache_count / 2);
+		return;
+	}
+
+	central_lock_acquire();
+	engine_free(bp);
+	central_lock_release();
+}
+
+/*
+ * Cached blocks are allocated as far as the engine is concerned, so any
+ * block can be handed to the engine's realloc
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+	void *newptr;
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+		return mm_malloc(size);
+
+	// If size == 0, then free block and return NULL
+	if (size == 0) {
+		mm_free(ptr);
+		return NULL;
+	}
+
+	central_lock_acquire();
+	newptr = engine_realloc(ptr, size);
+	central_lock_release();
+
+	return newptr;
+}
+
+size_t mm_usable_size(void *ptr)
+{
+	return engine_usable_size(ptr);
+}
+
+/*
+ * Aligned blocks come from the engine directly, but go to the cache like
+ * any other block when freed. Returns NULL if the engine cannot align.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+	void *bp;
+
+	if (!engine_memalign)
+		return NULL;
+
+	central_lock_acquire();
+	bp = engine_memalign(alignment, size);
+	central_lock_release();
+
+	return bp;
+}
+
+/*
+ * Give the free top of the engine's heap back. Blocks still in a thread
+ * cache are allocated as far as the engine is concerned and stay put.
+ * Returns 0 if the engine cannot trim.
+ */
+int mm_trim(size_t pad)
+{
+	int result;
+
+	if (!engine_trim)
+		return 0;
+
+	central_lock_acquire();
+	result = engine_trim(pad);
+	central_lock_release();
+
+	return result;
+}
+
+/******** The remaining content below are helper routines ********/
+
+
+/*
+ * get_tcache: returns the cache of the calling thread, emptied first if it
+ *             belongs to an older heap. A thread's first call registers
+ *             the cache to be flushed at thread exit. The cache is valid
+ *             before that, as registering may allocate and so come back.
+ */
+static tcache_t *get_tcache(void)
+{
+	tcache_t *tc = &tcache;
+
+	if (tc->generation != tcache_generation) {
+		bool first = (tc->generation == 0);
+
+		memset(tc->entries, 0, sizeof(tc->entries));
+		memset(tc->counts, 0, sizeof(tc->counts));
+		tc->generation = tcache_generation;
+
+		if (first) {
+			pthread_once(&tcache_key_once, tcache_create_key);
+			pthread_setspecific(tcache_key, tc);
+		}
+	}
+
+	return tc;
+}
+
+static void tcache_create_key(void)
+{
+	pthread_key_create(&tcache_key, tcache_thread_exit);
+}
+
+/*
+ * tcache_thread_exit: gives every cached block of an exiting thread back
+ *                     to the engine, unless the heap was reset meanwhile
+ */
+static void tcache_thread_exit(void *arg)
+{
+	tcache_t *tc = arg;
+	int class;
+
+	if (tc->generation != tcache_generation)
+		return;
+
+	for (class = 0; class < TCACHE_CLASSES; class++) {
+		tcache_flush(tc, class, tc->counts[class]);
+	}
+}
+
+/*
+ * tcache_refill: takes a batch of blocks for an empty class from the depot,
+ *                or else fetches one from the engine under a single lock
+ *                hold. Returns false if the engine has none.
+ */
+static bool tcache_refill(tcache_t *tc, int class)
+{
+	size_t size = (class + 1) * tcache_step;
+	tcache_entry_t *batch = depot_pop(class);
+	int i;
+
+	if (batch != NULL) {
+		tc->entries[class] = batch;
+		tc->counts[class] = batch->count;
+		return true;
+	}
+
+	central_lock_acquire();
+	for (i = 0; i < tcache_batch; i++) {
+		tcache_entry_t *entry = engine_malloc(size);
+		if (entry == NULL)
+			break;
+
+		entry->next = tc->entries[class];
+		tc->entries[class] = entry;
+		tc->counts[class]++;
+	}
+	central_lock_release();
+
+	return tc->entries[class] != NULL;
+}
+
+/*
+ * tcache_flush: passes count blocks of a class to the depot as one batch,
+ *               or frees them to the engine under a single lock hold if
+ *               the depot has enough of the class
+ */
+static void tcache_flush(tcache_t *tc, int class, int count)
+{
+	tcache_entry_t *batch = tc->entries[class];
+	tcache_entry_t *last = batch;
+	int taken;
+
+	if (count <= 0 || batch == NULL)
+		return;
+
+	for (taken = 1; taken < count && last->next != NULL; taken++)
+		last = last->next;
+
+	tc->entries[class] = last->next;
+	last->next = NULL;
+	batch->count = taken;
+	if (depot_push(class, batch)) {
+		tc->counts[class] -= taken;
+		return;
+	}
+
+	last->next = tc->entries[class];
+	tc->entries[class] = batch;
+
+	central_lock_acquire();
+	while (count-- > 0 && tc->entries[class] != NULL) {
+		tcache_entry_t *entry = tc->entries[class];
+		tc->entries[class] = entry->next;
+		tc->counts[class]--;
+		engine_free(entry);
+	}
+	central_lock_release();
+}
+
+/*
+ * depot_push: pushes a batch on the depot stack of its class. Returns false
+ *             and leaves the depot alone if it holds enough of the class.
+ */
+static bool depot_push(int class, tcache_entry_t *batch)
+{
+	uint32_t ref = depot_ref(batch);
+	uint64_t head, new_head;
+
+	if (__atomic_load_n(&depot_batches[class], __ATOMIC_RELAXED) >= depot_max_batches)
+		return false;
+
+	head = __atomic_load_n(&depot[class], __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&batch->next_batch, (uint32_t) head, __ATOMIC_RELAXED);
+		new_head = ((head >> 32) + 1) << 32 | ref;
+	} while (!__atomic_compare_exchange_n(&depot[class], &head, new_head, true,
+	                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	__atomic_fetch_add(&depot_batches[class], 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+/*
+ * depot_pop: takes the top batch off the depot stack of a class, or
+ *            returns NULL if it is empty. The next_batch read may come
+ *            from a batch another thread has taken meanwhile. It is still
+ *            heap memory, mapped even if the heap was trimmed below it
+ *            (see mm_init), and the tag makes the swap fail in that case.
+ */
+static tcache_entry_t *depot_pop(int class)
+{
+	uint64_t head, new_head;
+	tcache_entry_t *batch;
+
+	head = __atomic_load_n(&depot[class], __ATOMIC_ACQUIRE);
+	do {
+		if ((uint32_t) head == 0)
+			return NULL;
+
+		batch = depot_entry((uint32_t) head);
+		new_head = ((head >> 32) + 1) << 32 |
+		           __atomic_load_n(&batch->next_batch, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&depot[class], &head, new_head, true,
+	                                      __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	__atomic_fetch_sub(&depot_batches[class], 1, __ATOMIC_RELAXED);
+	return batch;
+}
+
+static uint32_t depot_ref(tcache_entry_t *entry)
+{
+	return (uint32_t) (((char *) entry - (char *) mem_heap_lo()) >> depot_ref_shift) + 1;
+}
+
+static tcache_entry_t *depot_entry(uint32_t ref)
+{
+	return (tcache_entry_t *) ((char *) mem_heap_lo() +
+	                           ((size_t) (ref - 1) << depot_ref_shift));
+}
+
+static void central_lock_acquire(void)
+{
+	pthread_mutex_lock(&central_lock);
+}
+
+static void central_lock_release(void)
+{
+	pthread_mutex_unlock(&central_lock);
+}
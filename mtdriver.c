@@ -0,0 +1,438 @@
+/*
+ * mtdriver.c - Multi-threaded driver for the malloc lab allocators.
+ *
+ * Every thread replays the same trace file against the shared allocator,
+ * with block ids private to the thread. Each block is filled with a
+ * pattern of its thread and id, which is checked before the block is
+ * freed or reallocated, so blocks handed to two threads at once show up
+ * as errors. The driver reports the throughput of all threads together.
+ *
+ * With -x, a block is not freed by the thread that allocated it but
+ * passed on to the next thread, which frees it, as in a pipeline of
+ * producers and consumers.
+ *
+ * With -s, the allocator's mm_status is called after the replay, if it
+ * has one, to print its own statistics such as lock contention.
+ *
+ * With -H, the heap is backed by huge pages (see memlib.c).
+ *
+ * usage: mtdriver -f <tracefile> [-t <threads>] [-n <rounds>] [-x] [-s] [-H]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAXLINE     1024
+#define MAXTHREADS  64
+#define MAXPENDING  256  /* blocks a mailbox holds before senders wait */
+
+/* One request of the trace */
+typedef struct {
+    char type;       /* 'a', 'f' or 'r' */
+    int index;       /* block id */
+    size_t size;     /* requested size for 'a' and 'r' */
+} mtop_t;
+
+typedef struct {
+    int num_ids;
+    int num_ops;
+    mtop_t *ops;
+} mttrace_t;
+
+/* Blocks passed to a thread for freeing, linked through their payload */
+typedef struct {
+    pthread_mutex_t lock;
+    void *head;
+    int count;
+    int closed;          /* set when the receiver is done */
+} mailbox_t;
+
+/* Arguments and results of one replay thread */
+typedef struct {
+    int id;
+    int rounds;
+    mttrace_t *trace;
+    mailbox_t *inbox;    /* blocks this thread frees for the previous one */
+    mailbox_t *outbox;   /* NULL unless blocks are freed by the next thread */
+    long errors;
+} mtthread_t;
+
+static mttrace_t *read_trace(char *filename);
+static void *replay(void *arg);
+static void release(mtthread_t *self, void *p);
+static void drain_inbox(mtthread_t *self);
+static unsigned char pattern(int thread, int index);
+static int check_block(unsigned char *p, size_t size, unsigned char c);
+static double now(void);
+static void usage(void);
+
+/* Not every allocator has one */
+extern void mm_status() __attribute__((weak));
+
+int main(int argc, char **argv)
+{
+    char *tracefile = NULL;
+    int num_threads = 4;
+    int rounds = 1;
+    int cross = 0;
+    int status = 0;
+    int c, i;
+    long errors = 0;
+    mtthread_t args[MAXTHREADS];
+    mailbox_t mailboxes[MAXTHREADS];
+    pthread_t threads[MAXTHREADS];
+
+    while ((c = getopt(argc, argv, "f:t:n:xsHh")) != EOF) {
+        switch (c) {
+        case 'f':
+            tracefile = optarg;
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            break;
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'x':
+            cross = 1;
+            break;
+        case 's':
+            status = 1;
+            break;
+        case 'H':
+            mem_set_huge_pages(1);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (tracefile == NULL || num_threads < 1 || num_threads > MAXTHREADS ||
+        rounds < 1) {
+        usage();
+        exit(1);
+    }
+
+    mttrace_t *trace = read_trace(tracefile);
+
+    mem_init();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&mailboxes[i].lock, NULL);
+        mailboxes[i].head = NULL;
+        mailboxes[i].count = 0;
+        mailboxes[i].closed = 0;
+    }
+
+    double start = now();
+    for (i = 0; i < num_threads; i++) {
+        args[i].id = i;
+        args[i].rounds = rounds;
+        args[i].trace = trace;
+        args[i].inbox = &mailboxes[i];
+        args[i].outbox = cross ? &mailboxes[(i + 1) % num_threads] : NULL;
+        args[i].errors = 0;
+        if (pthread_create(&threads[i], NULL, replay, &args[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        errors += args[i].errors;
+    }
+    /* Whatever was passed on after its receiver finished */
+    for (i = 0; i < num_threads; i++)
+        drain_inbox(&args[i]);
+    double secs = now() - start;
+
+    double ops = (double) trace->num_ops * rounds * num_threads;
+    printf("threads %d  ops %.0f  secs %.6f  Kops %.0f  heap %zu  committed %zu\n",
+           num_threads, ops, secs, ops / secs / 1e3, mem_heapsize(),
+           mem_committed());
+    if (status && mm_status)
+        mm_status();
+
+    if (errors) {
+        printf("Terminated with %ld errors\n", errors);
+        exit(1);
+    }
+
+    /*
+     * The heap is left to go with the process: the background thread of
+     * a front end such as mm_async may still be freeing into it
+     */
+    exit(0);
+}
+
+/*
+ * replay - run the trace rounds times with block ids of this thread
+ */
+static void *replay(void *arg)
+{
+    mtthread_t *self = arg;
+    mttrace_t *trace = self->trace;
+    unsigned char **blocks = calloc(trace->num_ids, sizeof(unsigned char *));
+    size_t *sizes = calloc(trace->num_ids, sizeof(size_t));
+    int r, i;
+
+    if (blocks == NULL || sizes == NULL) {
+        fprintf(stderr, "calloc failed in replay\n");
+        exit(1);
+    }
+
+    for (r = 0; r < self->rounds; r++) {
+        for (i = 0; i < trace->num_ops; i++) {
+            mtop_t *op = &trace->ops[i];
+            unsigned char c = pattern(self->id, op->index);
+            unsigned char *p;
+
+            switch (op->type) {
+            case 'a':
+                if ((p = mm_malloc(op->size)) == NULL) {
+                    fprintf(stderr, "thread %d op %d: mm_malloc failed\n",
+                            self->id, i);
+                    self->errors++;
+                    goto out;
+                }
+                memset(p, c, op->size);
+                blocks[op->index] = p;
+                sizes[op->index] = op->size;
+                break;
+
+            case 'r':
+                if (!check_block(blocks[op->index], sizes[op->index], c))
+                    self->errors++;
+                if ((p = mm_realloc(blocks[op->index], op->size)) == NULL) {
+                    fprintf(stderr, "thread %d op %d: mm_realloc failed\n",
+                            self->id, i);
+                    self->errors++;
+                    goto out;
+                }
+                size_t kept = sizes[op->index] < op->size ?
+                    sizes[op->index] : op->size;
+                if (!check_block(p, kept, c))
+                    self->errors++;
+                memset(p, c, op->size);
+                blocks[op->index] = p;
+                sizes[op->index] = op->size;
+                break;
+
+            case 'f':
+                if (!check_block(blocks[op->index], sizes[op->index], c))
+                    self->errors++;
+                release(self, blocks[op->index]);
+                blocks[op->index] = NULL;
+                sizes[op->index] = 0;
+                break;
+            }
+
+            /* Free what the previous thread passed on every so often */
+            if (self->outbox != NULL && i % 64 == 63)
+                drain_inbox(self);
+        }
+
+        /* Free whatever the trace left allocated before the next round */
+        for (i = 0; i < trace->num_ids; i++) {
+            if (blocks[i] != NULL) {
+                release(self, blocks[i]);
+                blocks[i] = NULL;
+            }
+        }
+        drain_inbox(self);
+    }
+
+ out:
+    /* Later senders free their blocks themselves */
+    pthread_mutex_lock(&self->inbox->lock);
+    self->inbox->closed = 1;
+    pthread_mutex_unlock(&self->inbox->lock);
+    drain_inbox(self);
+
+    free(blocks);
+    free(sizes);
+    return NULL;
+}
+
+/*
+ * release - free a block, or pass it on to the next thread with -x.
+ *     A sender waits while the mailbox is full, freeing its own mail
+ *     meanwhile, so that a ring of waiting threads still makes progress.
+ */
+static void release(mtthread_t *self, void *p)
+{
+    mailbox_t *box = self->outbox;
+
+    if (box == NULL) {
+        mm_free(p);
+        return;
+    }
+
+    pthread_mutex_lock(&box->lock);
+    while (box->count >= MAXPENDING && !box->closed) {
+        pthread_mutex_unlock(&box->lock);
+        drain_inbox(self);
+        sched_yield();
+        pthread_mutex_lock(&box->lock);
+    }
+
+    if (box->closed) {
+        pthread_mutex_unlock(&box->lock);
+        mm_free(p);
+        return;
+    }
+
+    *(void **) p = box->head;
+    box->head = p;
+    box->count++;
+    pthread_mutex_unlock(&box->lock);
+}
+
+/*
+ * drain_inbox - free every block the previous thread passed on
+ */
+static void drain_inbox(mtthread_t *self)
+{
+    void *p;
+
+    pthread_mutex_lock(&self->inbox->lock);
+    p = self->inbox->head;
+    self->inbox->head = NULL;
+    self->inbox->count = 0;
+    pthread_mutex_unlock(&self->inbox->lock);
+
+    while (p != NULL) {
+        void *next = *(void **) p;
+        mm_free(p);
+        p = next;
+    }
+}
+
+/*
+ * pattern - fill byte of one block, different for neighbouring ids
+ *     and threads
+ */
+static unsigned char pattern(int thread, int index)
+{
+    return (unsigned char) (thread * 31 + index * 7 + 1);
+}
+
+/*
+ * check_block - returns 0 and reports if a byte of the block was
+ *     overwritten by someone else
+ */
+static int check_block(unsigned char *p, size_t size, unsigned char c)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (p[i] != c) {
+            fprintf(stderr, "block %p corrupted at byte %zu\n", p, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * read_trace - read a trace file in the format of mdriver
+ */
+static mttrace_t *read_trace(char *filename)
+{
+    FILE *tracefile;
+    mttrace_t *trace;
+    char type[MAXLINE];
+    int sugg_heapsize, weight;
+    unsigned index;
+    size_t size;
+    int i = 0;
+
+    if ((tracefile = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        exit(1);
+    }
+
+    if ((trace = malloc(sizeof(mttrace_t))) == NULL) {
+        fprintf(stderr, "malloc failed in read_trace\n");
+        exit(1);
+    }
+
+    if (fscanf(tracefile, "%d %d %d %d", &sugg_heapsize, &trace->num_ids,
+               &trace->num_ops, &weight) != 4) {
+        fprintf(stderr, "Bad trace header in %s\n", filename);
+        exit(1);
+    }
+
+    if ((trace->ops = malloc(trace->num_ops * sizeof(mtop_t))) == NULL) {
+        fprintf(stderr, "malloc failed in read_trace\n");
+        exit(1);
+    }
+
+    while (i < trace->num_ops && fscanf(tracefile, "%s", type) != EOF) {
+        trace->ops[i].type = type[0];
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            if (fscanf(tracefile, "%u %zu", &index, &size) != 2)
+                goto bad;
+            trace->ops[i].index = index;
+            trace->ops[i].size = size;
+            break;
+        case 'f':
+            if (fscanf(tracefile, "%u", &index) != 1)
+                goto bad;
+            trace->ops[i].index = index;
+            trace->ops[i].size = 0;
+            break;
+        default:
+            goto bad;
+        }
+        if (index >= (unsigned) trace->num_ids)
+            goto bad;
+        i++;
+    }
+    fclose(tracefile);
+
+    trace->num_ops = i;
+    return trace;
+
+ bad:
+    fprintf(stderr, "Bogus request %d in tracefile %s\n", i, filename);
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtdriver -f <file> [-t <threads>] [-n <rounds>] [-x] [-s] [-H]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>     Replay this trace file.\n");
+    fprintf(stderr, "\t-t <threads>  Number of threads replaying it (default 4).\n");
+    fprintf(stderr, "\t-n <rounds>   Times every thread replays it (default 1).\n");
+    fprintf(stderr, "\t-x            Free every block in the next thread.\n");
+    fprintf(stderr, "\t-s            Print the allocator's status afterwards.\n");
+    fprintf(stderr, "\t-H            Back the heap with huge pages.\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+}
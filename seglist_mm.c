@@ -0,0 +1,1468 @@
+/*
+ ******************************************************************************
+ *                                   mm.c                                     *
+ *         64-bit struct-based segregated free list memory allocator          *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *             Modified version of one provided to students in malloc lab     *
+ *  This version keeps one circular free list per size class, plus a bitmap   *
+ *  of the non-empty classes, so a request jumps straight to the first list   *
+ *  that can actually satisfy it. Tiny objects are served from header-less    *
+ *  slab runs carved out of the same heap, and freed small blocks wait in     *
+ *  fast bins until a consolidation pass coalesces them. The pages inside     *
+ *  large free blocks that stay unused are given back to the system.          *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+team_t team = {
+		/* Team name */
+		"ateam",
+		/* First member's full name */
+		"Harry Bovik",
+		/* First member's email address */
+		"bovik@cs.cmu.edu",
+		/* Second member's full name (leave blank if none) */
+		"",
+		/* Second member's email address (leave blank if none) */
+		""
+};
+
+/* Basic constants */
+
+typedef uint64_t word_t;
+
+// Word and header size (bytes)
+static const size_t wsize = sizeof(word_t);
+
+// Double word size (bytes)
+static const size_t dsize = 2 * sizeof(word_t);
+
+/*
+  Minimum useable block size (bytes):
+  two words for header & footer, two words for payload
+*/
+static const size_t min_block_size = 4 * sizeof(word_t);
+
+// Mask to extract allocated bit from header
+static const word_t alloc_mask = 0x1;
+
+// Mask of the header bit of a free block whose pages were purged
+static const word_t purged_mask = 0x2;
+
+// Mask of the header bit of an allocated block that waits in a fast bin
+static const word_t binned_mask = 0x4;
+
+/*
+ * Assume: All block sizes are a multiple of 16
+ * and so can use lower 4 bits for flags
+ */
+static const word_t size_mask = ~(word_t) 0xF;
+
+static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
+
+/*
+  Number of segregated size classes, and the number of 64-bit words of
+  the bitmap that records which of them are non-empty.
+*/
+#define NUM_CLASSES 128
+#define BITMAP_WORDS (NUM_CLASSES / 64)
+
+/*
+  With power-of-two classes, class 0 holds the 32 byte minimum blocks and
+  class i (i > 0) holds blocks of size (2^(i+4), 2^(i+5)].
+
+  With exact small bins, every block size up to 2^small_bin_shift bytes
+  (32, 48, ..., 1024) has a bin of its own, and the power-of-two classes
+  only start above that.
+
+  In both layouts the last class collects everything bigger.
+*/
+static const int class_type = 1; // 0 for power-of-two classes, 1 for exact small bins
+static const int small_bin_shift = 10;
+
+/*
+  Slab front end. Requests of at most slab_max_size bytes are served from
+  page-sized runs, each dedicated to one object size (16, 32, 48 or 64).
+  A run is an allocated block of exactly one page whose payload starts on
+  a page boundary, so consecutive runs tile the heap without gaps. The
+  payload starts with a run descriptor, followed by the objects, which
+  have no header at all.
+
+  A page map with one bit per heap page tells mm_free whether a pointer
+  lies in a run, and the descriptor is found by rounding down to the page.
+*/
+static const bool use_slab = true;
+static const size_t slab_max_size = 64;
+static const size_t slab_run_size = (1 << 12);
+
+#define SLAB_CLASSES 4
+#define SLAB_BITMAP_WORDS 4                           // up to 256 objects a run
+#define SLAB_PAGEMAP_WORDS (MAX_HEAP / (1 << 12) / 64 + 2)
+
+/*
+  Fast bins. A freed block of at most fast_max_size bytes keeps its
+  allocated bit and is pushed on the LIFO bin of its exact size instead
+  of being coalesced, so the next request of that size takes it back
+  without splitting. Neighbours see it as allocated, the binned bit tells
+  a second free of it apart from a valid one. Coalescing is deferred
+  until a request finds no fit, when consolidate_fast_bins frees every
+  binned block for real before the heap is extended.
+*/
+static const bool use_fast_bins = true;
+static const size_t fast_max_size = 128;
+
+#define FAST_BINS 7                                   // 32, 48, ..., 128
+
+/*
+  Purging. The whole pages inside a free block of at least purge_min_size
+  bytes are given back to the system (mem_purge) once the block has stayed
+  free and unchanged for purge_decay ticks of the purge clock, which
+  counts either calls to mm_malloc and mm_free or milliseconds. Such a
+  block keeps the time it was freed in the word after its list links.
+  Every purge_interval calls the large classes are scanned for blocks
+  that decayed, and those are marked purged in their header. Bytes that
+  mm_malloc hands out from purged pages are counted as retouched, as they
+  fault back in on first use. A purged block that is coalesced or split
+  is purged again when the result decays.
+*/
+static const bool use_purge = true;
+static const int purge_clock_type = 0; // 0 counts calls, 1 milliseconds
+static const word_t purge_decay = 8192;
+static const size_t purge_min_size = (1 << 14);
+static const unsigned purge_interval = 1024;
+
+/*
+  Trimming. When mm_free leaves a free block of at least trim_threshold
+  bytes at the end of the heap, all of it but trim_pad bytes is given
+  back with a negative mem_sbrk, in whole pages. mm_trim(pad) does the
+  same on request, whatever the size of the block, and also purges the
+  large free blocks inside the heap without waiting for them to decay.
+  A front end can turn the trimming by mm_free off with mm_auto_trim.
+*/
+static const bool use_trim = true;
+static const size_t trim_threshold = (1 << 17);
+static const size_t trim_pad = (1 << 16);
+
+/*
+  All blocks have both headers and footers
+
+  Both the header and the footer consist of a single word containing the
+  size and the allocation flag, where size is the total size of the block,
+  including header, (possibly payload), unused space, and footer
+*/
+
+/* Representation of the header and payload of one block in the heap */
+typedef struct block
+{
+	word_t header;
+	/*
+	 * We don't know what the size of the payload will be, so we will
+	 * declare it as a zero-length array.  This allow us to obtain a
+	 * pointer to the start of the payload.
+	 */
+
+	unsigned char payload[0];
+	struct block *previous;
+	struct block *next;
+
+} block_t;
+
+/* Descriptor at the start of every slab run */
+typedef struct slab_run
+{
+	// links of the list of runs of this class that have a free object
+	struct slab_run *previous;
+	struct slab_run *next;
+
+	uint32_t class;
+	uint32_t free_count;
+	// bit i is set when object i of the run is free
+	uint64_t free_map[SLAB_BITMAP_WORDS];
+
+} slab_run_t;
+
+
+/* Global variables */
+
+// Cleared by a front end that frees from a thread the heap may be reset under
+static bool auto_trim = true;
+
+// Pointer to first block
+static block_t *heap_start = NULL;
+// Pointer to last block.  This is an empty, but allocated block
+static block_t *heap_end = NULL;
+
+// Root of the circular free list of every size class
+static block_t *seg_list[NUM_CLASSES];
+// Bit i is set when seg_list[i] is non-empty
+static uint64_t class_bitmap[BITMAP_WORDS];
+
+// Runs of every slab class with at least one free object
+static slab_run_t *slab_partial[SLAB_CLASSES];
+// Bit i is set when heap page i is a slab run
+static uint64_t slab_pagemap[SLAB_PAGEMAP_WORDS];
+// Highest page index ever marked in slab_pagemap
+static size_t slab_pagemap_top = 0;
+
+// Single-linked LIFO of binned blocks of every fast bin size
+static block_t *fast_bin[FAST_BINS];
+
+// The purge clock and the calls since the last scan
+static word_t purge_now = 0;
+static unsigned purge_calls = 0;
+// Bytes released in blocks still marked purged, all bytes ever released,
+// and bytes of purged pages handed out again
+static size_t purged_bytes = 0;
+static size_t purged_total = 0;
+static size_t retouched_bytes = 0;
+
+/* Function prototypes for internal helper routines */
+
+static block_t *find_fit(size_t asize);
+static block_t *take_free_block(size_t asize, unsigned char **lo, unsigned char **hi);
+static void count_retouched(block_t *block, unsigned char *lo, unsigned char *hi);
+static void *aligned_malloc(size_t alignment, size_t size);
+static block_t *search_class(int class, size_t asize);
+static block_t *coalesce_block(block_t *block);
+static void split_block(block_t *block, size_t asize);
+
+static size_t round_up(size_t size, size_t n);
+static word_t pack(size_t size, bool alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc);
+static void write_footer(block_t *block, size_t size, bool alloc);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+static word_t *header_to_footer(block_t *block);
+
+static block_t *find_next(block_t *block);
+static word_t *find_prev_footer(block_t *block);
+static block_t *find_prev(block_t *block);
+static block_t *extend_heap(size_t size);
+void mm_status();
+void mm_free_batch(void **ptrs, int count);
+void *mm_memalign(size_t alignment, size_t size);
+int mm_trim(size_t pad);
+void mm_auto_trim(bool enable);
+static word_t get_payload_size(block_t *block);
+
+// functions only for segregated list
+void free_list_status();
+static int find_class(size_t asize);
+static bool is_exact_class(int class);
+static int next_nonempty_class(int class);
+static void append_free_list(block_t *block);
+static void disconnect_block(block_t *block);
+
+// functions only for the fast bins
+static int fast_bin_index(size_t asize);
+static void consolidate_fast_bins(void);
+
+// functions only for the slab front end
+static void *slab_malloc(size_t size);
+static void slab_free(void *bp);
+static slab_run_t *slab_new_run(int class);
+static void slab_release_run(slab_run_t *run);
+static bool is_slab_object(void *bp);
+static void set_slab_page(void *page, bool is_slab);
+static size_t slab_object_size(int class);
+static size_t slab_object_count(int class);
+static unsigned char *slab_objects(slab_run_t *run);
+
+// functions only for trimming
+static int trim_heap(size_t pad);
+
+// functions only for purging
+static void purge_tick(void);
+static size_t purge_free_pages(word_t decay);
+static bool is_purged(block_t *block);
+static word_t *purge_stamp(block_t *block);
+static size_t purge_range(block_t *block, unsigned char **lo, unsigned char **hi);
+
+void log_block(block_t *block){
+	bool is_allocate = get_alloc(block);
+	printf("Block address %p,  size = %zd, allocated = %s, ",
+	       block,
+	       get_size(block),
+	       is_allocate ? "Y" : "N");
+
+	if(!is_allocate) {
+		block_t *prev_free = block->previous, *next_free = block->next;
+		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
+	}
+
+	printf("\n");
+}
+
+static const int fit_type = 2; // 0 for first fit, 2 for best fit inside a class
+static const int add_type = 1; // 1 for LIFO, 2 for FIFO
+
+
+/*
+  Initialize a heap to have byte_count bytes starting at address start.
+  Assume start and byte_count are multiples of dsize.
+ */
+int mm_init()
+{
+	word_t *start = (word_t*)(mem_sbrk(2 * wsize));
+	if(start == (void *)-1) {
+		return -1;
+	}
+
+	start[0] = pack(0, true); // Prologue footer
+	start[1] = pack(0, true); // Epilogue header
+
+	heap_end = (block_t *) &start[1];
+	memset(seg_list, 0, sizeof(seg_list));
+	memset(class_bitmap, 0, sizeof(class_bitmap));
+	memset(slab_partial, 0, sizeof(slab_partial));
+	memset(slab_pagemap, 0, (slab_pagemap_top / 64 + 1) * sizeof(uint64_t));
+	slab_pagemap_top = 0;
+	memset(fast_bin, 0, sizeof(fast_bin));
+	purge_now = 0;
+	purge_calls = 0;
+	purged_bytes = purged_total = retouched_bytes = 0;
+
+	// Extend the empty heap with a free block of chunksize bytes
+	if ((heap_start = extend_heap(chunksize)) == NULL)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate space for payload of size bytes
+ */
+void *mm_malloc(size_t size)
+{
+	size_t asize;      // Allocated block size
+	block_t *block = NULL;
+	void *bp = NULL;
+	unsigned char *lo, *hi; // Purged pages of the free block taken
+
+	if (size == 0) // Ignore spurious request
+		return bp;
+
+	if (use_purge)
+		purge_tick();
+
+	// Tiny objects come from a slab run, if one can be had
+	if (use_slab && size <= slab_max_size && (bp = slab_malloc(size)) != NULL)
+		return bp;
+
+	asize = round_up(size + dsize, dsize);
+
+	// A binned block of the exact size is still marked allocated
+	if (use_fast_bins && asize <= fast_max_size && fast_bin[fast_bin_index(asize)] != NULL) {
+		block = fast_bin[fast_bin_index(asize)];
+		fast_bin[fast_bin_index(asize)] = block->next;
+		block->header &= ~binned_mask;
+		return header_to_payload(block);
+	}
+
+	if((block = take_free_block(asize, &lo, &hi)) == NULL) {
+		return NULL;
+	}
+
+	// Mark block as allocated
+	size_t block_size = get_size(block);
+	write_header(block, block_size, true);
+	write_footer(block, block_size, true);
+
+	// Try to split the block if too large
+	split_block(block, asize);
+	count_retouched(block, lo, hi);
+	bp = header_to_payload(block);
+
+	return bp;
+}
+
+/* Free allocated block */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	if (use_purge)
+		purge_tick();
+
+	if (use_slab && is_slab_object(bp)) {
+		slab_free(bp);
+		return;
+	}
+
+	block_t *block = payload_to_header(bp);
+	size_t size = get_size(block);
+
+	// The block should be marked as allocated, and not be binned already
+	if (!get_alloc(block) || (block->header & binned_mask)) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	// Small blocks are binned as they are, coalescing comes later
+	if (use_fast_bins && size <= fast_max_size) {
+		block->header |= binned_mask;
+		block->next = fast_bin[fast_bin_index(size)];
+		fast_bin[fast_bin_index(size)] = block;
+		return;
+	}
+
+	// Mark the block as free
+	write_header(block, size, false);
+	write_footer(block, size, false);
+
+	// Try to coalesce the block with its neighbors
+	block = coalesce_block(block);
+
+	// A large free block at the end of the heap goes back to the system
+	if (use_trim && auto_trim && find_next(block) == heap_end && get_size(block) >= trim_threshold)
+		trim_heap(trim_pad);
+}
+
+/*
+ * Free count blocks sorted by address at once. Every run of blocks that
+ * are neighbors on the heap becomes one free block first, so a run is
+ * coalesced with the rest of the heap and relinked only once. Fast bins
+ * are bypassed, the batch has already waited.
+ */
+void mm_free_batch(void **ptrs, int count)
+{
+	block_t *run = NULL;   // first block of the open run
+	block_t *run_end = NULL;
+	int i;
+
+	for(i = 0; i <= count; i++) {
+		block_t *block = NULL;
+
+		if(i < count) {
+			if(ptrs[i] == NULL) continue;
+
+			if (use_slab && is_slab_object(ptrs[i])) {
+				slab_free(ptrs[i]);
+				continue;
+			}
+
+			block = payload_to_header(ptrs[i]);
+			if (!get_alloc(block) || (block->header & binned_mask)) {
+				fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+				exit(1);
+			}
+
+			// The block continues the open run
+			if(block == run_end) {
+				run_end = find_next(block);
+				continue;
+			}
+		}
+
+		// Close the open run, then start a new one at this block
+		if(run != NULL) {
+			size_t size = (unsigned char *) run_end - (unsigned char *) run;
+			write_header(run, size, false);
+			write_footer(run, size, false);
+			run = coalesce_block(run);
+
+			if (use_trim && auto_trim && find_next(run) == heap_end && get_size(run) >= trim_threshold)
+				trim_heap(trim_pad);
+		}
+
+		run = block;
+		run_end = (block != NULL) ? find_next(block) : NULL;
+	}
+}
+
+/*
+ * Allocate size bytes whose payload starts at a multiple of alignment, a
+ * power of two. Any block is already aligned to dsize.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+	if (size == 0) // Ignore spurious request
+		return NULL;
+
+	if (alignment <= dsize)
+		return mm_malloc(size);
+
+	return aligned_malloc(alignment, size);
+}
+
+/*
+ * Give the free block at the end of the heap back to the system, all but
+ * pad bytes of it, and purge every large free block inside the heap
+ * without waiting for it to decay. The fast bins are consolidated first,
+ * so a binned block does not hold memory. Returns 1 if any was released.
+ */
+int mm_trim(size_t pad)
+{
+	int released;
+
+	if (use_fast_bins)
+		consolidate_fast_bins();
+
+	released = trim_heap(pad);
+	if (use_purge && purge_free_pages(0) > 0)
+		released = 1;
+
+	return released;
+}
+
+/*
+ * Turn the trimming by mm_free on or off. mm_trim works either way.
+ */
+void mm_auto_trim(bool enable)
+{
+	auto_trim = enable;
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+	size_t copysize;
+	void *newptr;
+
+	// If size == 0, then free block and return NULL
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+	{
+		return mm_malloc(size);
+	}
+
+	// A slab object that still has the right size class stays where it is
+	if (use_slab && is_slab_object(ptr) && size <= mm_usable_size(ptr) &&
+	    size + dsize > mm_usable_size(ptr))
+	{
+		return ptr;
+	}
+
+	// Otherwise, proceed with reallocation
+	newptr = mm_malloc(size);
+	// If malloc fails, the original block is left untouched
+	if (!newptr)
+	{
+		return NULL;
+	}
+
+	// Copy the old data
+	copysize = mm_usable_size(ptr); // gets size of old payload
+	if(size < copysize)
+	{
+		copysize = size;
+	}
+	memcpy(newptr, ptr, copysize);
+
+	// Free the old block
+	mm_free(ptr);
+
+	return newptr;
+}
+
+/* Print status of every block in heap */
+void mm_status() {
+	block_t *block = heap_start;
+	printf("The whole heap status\n");
+	printf("*******************************\n");
+	while (block != heap_end) {
+		log_block(block);
+		block = find_next(block);
+	}
+	printf("Head End: ");
+	log_block(heap_end);
+	if (use_purge)
+		printf("Purged: %zu bytes now, %zu in total, %zu retouched\n",
+		       purged_bytes, purged_total, retouched_bytes);
+	printf("*******************************\n");
+}
+
+/* Print every non-empty size class */
+void free_list_status() {
+	int class;
+
+	for(class = 0; class < NUM_CLASSES; class++) {
+		block_t *block = seg_list[class];
+		if(block == NULL) continue;
+
+		printf("Size class %d\n", class);
+		printf("-------------------------------\n");
+		do{
+			log_block(block);
+			block = block->next;
+		}while(block != seg_list[class]);
+		printf("-------------------------------\n");
+	}
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+
+/*
+ * Attempt to coalesce block with its predecessor and successor,
+ * then put the result into its size class. Returns the coalesced block.
+ */
+static block_t *coalesce_block(block_t *block)
+{
+	size_t size = get_size(block);
+
+	block_t *block_next = find_next(block);
+	block_t *block_prev = find_prev(block);
+
+	bool prev_alloc = extract_alloc(*find_prev_footer(block));
+	bool next_alloc = get_alloc(block_next);
+
+	if (prev_alloc && next_alloc)              // Case 1
+	{
+		//Nothing to do
+	}
+
+	else if (prev_alloc && !next_alloc)        // Case 2
+	{
+		disconnect_block(block_next);
+
+		size += get_size(block_next);
+		write_header(block, size, false);
+		write_footer(block, size, false);
+	}
+
+	else if (!prev_alloc && next_alloc)        // Case 3
+	{
+		disconnect_block(block_prev);
+
+		size += get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	else                                        // Case 4
+	{
+		disconnect_block(block_prev);
+		disconnect_block(block_next);
+
+		size += get_size(block_next) + get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	append_free_list(block);
+	return block;
+}
+
+
+/*
+ * See if new block can be split one to satisfy allocation
+ * and one to keep free. The block must already be off its free list.
+ */
+static void split_block(block_t *block, size_t asize)
+{
+	size_t block_size = get_size(block);
+
+	if ((block_size - asize) >= min_block_size)
+	{
+		write_header(block, asize, true);
+		write_footer(block, asize, true);
+
+		block_t *block_next = find_next(block);
+		write_header(block_next, block_size - asize, false);
+		write_footer(block_next, block_size - asize, false);
+
+		// The block after the remainder is allocated, no need to coalesce
+		append_free_list(block_next);
+	}
+}
+
+
+/*
+ * Take a free block of size at least asize off its list, consolidating
+ * the fast bins and then growing the heap if no class can satisfy the
+ * request. The purged pages of the block are left in [lo, hi), an empty
+ * range if there are none. Returns NULL when out of memory.
+ */
+static block_t *take_free_block(size_t asize, unsigned char **lo, unsigned char **hi) {
+	block_t *block = find_fit(asize);
+
+	if(block == NULL && use_fast_bins) {
+		consolidate_fast_bins();
+		block = find_fit(asize);
+	}
+
+	if(block == NULL) {
+		size_t extend_size = asize > chunksize ? asize : chunksize;
+		if((block = extend_heap(extend_size)) == NULL) {
+			return NULL;
+		}
+	}
+
+	// Once split, the part handed out tells how much faults back in
+	*lo = *hi = NULL;
+	if(use_purge && is_purged(block)) {
+		purge_range(block, lo, hi);
+	}
+
+	disconnect_block(block);
+	return block;
+}
+
+/*
+ * Count the bytes of an allocated block that lie on the purged pages
+ * [lo, hi) of the free block it was cut from, as they fault back in
+ */
+static void count_retouched(block_t *block, unsigned char *lo, unsigned char *hi)
+{
+	unsigned char *start = (unsigned char *) block;
+	unsigned char *end = start + get_size(block);
+
+	if(start < lo) start = lo;
+	if(end > hi) end = hi;
+	if(end > start) {
+		retouched_bytes += end - start;
+	}
+}
+
+/*
+ * Allocate size bytes whose payload starts at a multiple of alignment,
+ * a power of two. The free block taken is large enough to slide the
+ * payload up to an aligned address and still leave a whole free block
+ * in front of it.
+ */
+static void *aligned_malloc(size_t alignment, size_t size)
+{
+	size_t asize = round_up(size + dsize, dsize);
+	block_t *block;
+	unsigned char *lo, *hi;
+
+	if((block = take_free_block(asize + alignment + min_block_size, &lo, &hi)) == NULL) {
+		return NULL;
+	}
+
+	size_t block_size = get_size(block);
+	uintptr_t payload = (uintptr_t) header_to_payload(block);
+	uintptr_t aligned = (payload + alignment - 1) & ~(uintptr_t) (alignment - 1);
+
+	if(aligned != payload && aligned - payload < min_block_size) {
+		aligned += alignment;
+	}
+
+	// Give the leading part back, its previous block is allocated
+	if(aligned != payload) {
+		size_t lead = aligned - payload;
+		write_header(block, lead, false);
+		write_footer(block, lead, false);
+		append_free_list(block);
+
+		block = (block_t *) ((unsigned char *) block + lead);
+		block_size -= lead;
+	}
+
+	write_header(block, block_size, true);
+	write_footer(block, block_size, true);
+	split_block(block, asize);
+	count_retouched(block, lo, hi);
+
+	return header_to_payload(block);
+}
+
+/*
+ * Find a free block of size at least asize, looking only at the class
+ * of the request and the non-empty classes above it. Every block of a
+ * class above the request fits, so at most two lists are searched.
+ */
+static block_t *find_fit(size_t asize) {
+	int class;
+	block_t *block;
+
+	for(class = next_nonempty_class(find_class(asize));
+	    class >= 0;
+	    class = next_nonempty_class(class + 1)) {
+		if((block = search_class(class, asize)) != NULL) {
+			return block;
+		}
+	}
+
+	return NULL; // no fit found
+}
+
+/*
+ * Search one size class with the discipline selected by fit_type
+ */
+static block_t *search_class(int class, size_t asize) {
+	block_t *root = seg_list[class];
+	block_t *block = root;
+	block_t *best_block = NULL;
+
+	if(root == NULL) return NULL;
+
+	// every block of an exact bin has the same size
+	if(is_exact_class(class)) return (asize <= get_size(root)) ? root : NULL;
+
+	do{
+		if (asize <= get_size(block)) {
+			if(fit_type == 0) return block;
+
+			if(best_block == NULL || (get_size(best_block) > get_size(block))){
+				best_block = block;
+				if(get_size(block) == asize) break;
+			}
+		}
+
+		block = block->next;
+
+	}while(block != root);
+
+	return best_block;
+}
+
+/*
+ * Grow the heap by size bytes and return the (coalesced) free block
+ * at the end of the heap
+ */
+static block_t *extend_heap(size_t size)
+{
+	void *bp;
+
+	// Allocate an even number of words to maintain alignment
+	size = round_up(size, dsize);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+	{
+		return NULL;
+	}
+
+	// Initialize free block header/footer
+	block_t *block = payload_to_header(bp);
+	write_header(block, size, false);
+	write_footer(block, size, false);
+	// Create new epilogue header
+	block_t *block_next = find_next(block);
+	write_header(block_next, 0, true);
+	heap_end = block_next;
+
+	// Coalesce in case the previous block was free
+	return coalesce_block(block);
+}
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+	return n * ((size + (n-1)) / n);
+}
+
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ */
+static word_t pack(size_t size, bool alloc)
+{
+	return alloc ? (size | alloc_mask) : size;
+}
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+	return (word & size_mask);
+}
+
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the heap is 16-byte aligned).
+ */
+static size_t get_size(block_t *block)
+{
+	return extract_size(block->header);
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+	return (bool) (word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+	return extract_alloc(block->header);
+}
+
+
+/*
+ * write_header: given a block and its size and allocation status,
+ *               writes an appropriate value to the block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc)
+{
+	block->header = pack(size, alloc);
+}
+
+
+/*
+ * write_footer: given a block and its size and allocation status,
+ *               writes an appropriate value to the block footer by first
+ *               computing the position of the footer.
+ */
+static void write_footer(block_t *block, size_t size, bool alloc)
+{
+	word_t *footerp = header_to_footer(block);
+	*footerp = pack(size, alloc);
+}
+
+
+/*
+ * find_next: returns the next consecutive block on the heap by adding the
+ *            size of the block.
+ */
+static block_t *find_next(block_t *block)
+{
+	return (block_t *) ((unsigned char *) block + get_size(block));
+}
+
+
+/*
+ * find_prev_footer: returns the footer of the previous block.
+ */
+static word_t *find_prev_footer(block_t *block)
+{
+	// Compute previous footer position as one word before the header
+	return &(block->header) - 1;
+}
+
+
+/*
+ * find_prev: returns the previous block position by checking the previous
+ *            block's footer and calculating the start of the previous block
+ *            based on its size.
+ */
+static block_t *find_prev(block_t *block)
+{
+	word_t *footerp = find_prev_footer(block);
+	size_t size = extract_size(*footerp);
+	return (block_t *) ((unsigned char *) block - size);
+}
+
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+	return (void *) (block->payload);
+}
+
+
+/*
+ * header_to_footer: given a block pointer, returns a pointer to the
+ *                   corresponding footer.
+ */
+static word_t *header_to_footer(block_t *block)
+{
+	return (word_t *) (block->payload + get_size(block) - dsize);
+}
+
+static word_t get_payload_size(block_t *block)
+{
+	size_t asize = get_size(block);
+	return asize - dsize;
+}
+
+
+/*
+ * find_class: maps a block size to its size class according to class_type,
+ *             using count-leading-zeros to find the power-of-two class.
+ */
+static int find_class(size_t asize)
+{
+	int class, exact_bins, log_size;
+
+	if(asize <= min_block_size) return 0;
+
+	exact_bins = ((1 << small_bin_shift) - min_block_size) / dsize + 1;
+	if(class_type == 1 && asize <= ((size_t) 1 << small_bin_shift)) {
+		return (asize - min_block_size) / dsize;
+	}
+
+	// smallest k with asize <= 2^k
+	log_size = 64 - __builtin_clzll((unsigned long long) (asize - 1));
+
+	if(class_type == 1) {
+		class = exact_bins + log_size - small_bin_shift - 1;
+	}else{
+		class = log_size - 5;
+	}
+
+	return (class < NUM_CLASSES - 1) ? class : NUM_CLASSES - 1;
+}
+
+/*
+ * is_exact_class: returns true when the class only holds blocks of a single size
+ */
+static bool is_exact_class(int class)
+{
+	return class_type == 1 &&
+	       class < ((1 << small_bin_shift) - (int) min_block_size) / (int) dsize + 1;
+}
+
+/*
+ * next_nonempty_class: returns the first non-empty class that is not below
+ *                      class, or -1 if there is none. One count-trailing-zeros
+ *                      per bitmap word replaces the walk over empty classes.
+ */
+static int next_nonempty_class(int class)
+{
+	int word;
+	uint64_t bits;
+
+	if(class >= NUM_CLASSES) return -1;
+
+	word = class / 64;
+	bits = class_bitmap[word] & (~(uint64_t) 0 << (class % 64));
+
+	while(bits == 0) {
+		if(++word == BITMAP_WORDS) return -1;
+		bits = class_bitmap[word];
+	}
+
+	return word * 64 + __builtin_ctzll(bits);
+}
+
+// put the block into the circular list of its size class
+static void append_free_list(block_t *block) {
+	if(get_alloc(block)) {
+		fprintf(stderr, "Cannot add an allocated ptr to the free list\n");
+		exit(-1);
+	}
+
+	int class = find_class(get_size(block));
+	block_t *root = seg_list[class];
+
+	// empty class, the block becomes its own circle
+	if(root == NULL) {
+		block->previous = block;
+		block->next = block;
+		seg_list[class] = block;
+		class_bitmap[class / 64] |= (uint64_t) 1 << (class % 64);
+		if(use_purge && get_size(block) >= purge_min_size) *purge_stamp(block) = purge_now;
+		return;
+	}
+
+	// connect the block to the prev of the root
+	block->next = root;
+	block->previous = root->previous;
+	root->previous->next = block;
+	root->previous = block;
+
+	// LIFO starts the next search at the new block, FIFO leaves it at the end
+	if(add_type == 1) {
+		seg_list[class] = block;
+	}
+
+	if(use_purge && get_size(block) >= purge_min_size) *purge_stamp(block) = purge_now;
+}
+
+// take the block out of the circular list of its size class
+static void disconnect_block(block_t *block) {
+	int class = find_class(get_size(block));
+
+	// the block is about to change, it stops counting as purged
+	if(use_purge && is_purged(block)) {
+		unsigned char *lo, *hi;
+		purged_bytes -= purge_range(block, &lo, &hi);
+	}
+
+	if(block->next == block) {
+		seg_list[class] = NULL;
+		class_bitmap[class / 64] &= ~((uint64_t) 1 << (class % 64));
+		return;
+	}
+
+	block_t *cur_prev = block->previous, *cur_next = block->next;
+	cur_prev->next = cur_next;
+	cur_next->previous = cur_prev;
+
+	if(block == seg_list[class]) seg_list[class] = cur_next;
+}
+
+
+/*
+ * fast_bin_index: returns the fast bin of blocks of exactly asize bytes
+ */
+static int fast_bin_index(size_t asize)
+{
+	return (asize - min_block_size) / dsize;
+}
+
+/*
+ * consolidate_fast_bins: empties every fast bin, marking each block free
+ *                        and coalescing it into the size classes
+ */
+static void consolidate_fast_bins(void)
+{
+	int bin;
+	block_t *block;
+
+	for(bin = 0; bin < FAST_BINS; bin++) {
+		while((block = fast_bin[bin]) != NULL) {
+			fast_bin[bin] = block->next;
+
+			size_t size = get_size(block);
+			write_header(block, size, false);
+			write_footer(block, size, false);
+			coalesce_block(block);
+		}
+	}
+}
+
+/*
+ * slab_malloc: hands out a free object of the smallest slab class that
+ *              holds size bytes, starting a new run if the class has none.
+ *              Returns NULL if no run can be allocated.
+ */
+static void *slab_malloc(size_t size)
+{
+	int class = (size + dsize - 1) / dsize - 1;
+	slab_run_t *run = slab_partial[class];
+	int word = 0;
+
+	if(run == NULL && (run = slab_new_run(class)) == NULL) {
+		return NULL;
+	}
+
+	while(run->free_map[word] == 0) word++;
+	int index = word * 64 + __builtin_ctzll(run->free_map[word]);
+	run->free_map[word] &= ~((uint64_t) 1 << (index % 64));
+
+	// a full run leaves the partial list until one of its objects is freed
+	if(--run->free_count == 0) {
+		slab_partial[class] = run->next;
+		if(run->next != NULL) run->next->previous = NULL;
+	}
+
+	return slab_objects(run) + index * slab_object_size(class);
+}
+
+/*
+ * slab_free: returns an object to its run. A run whose objects are all
+ *            free again goes back to the heap, unless it is the last run
+ *            of its class with free objects.
+ */
+static void slab_free(void *bp)
+{
+	slab_run_t *run = (slab_run_t *) ((uintptr_t) bp & ~(uintptr_t) (slab_run_size - 1));
+	size_t index = ((unsigned char *) bp - slab_objects(run)) / slab_object_size(run->class);
+	uint64_t bit = (uint64_t) 1 << (index % 64);
+
+	if(run->free_map[index / 64] & bit) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	run->free_map[index / 64] |= bit;
+
+	// a full run is back to partial
+	if(run->free_count++ == 0) {
+		run->previous = NULL;
+		run->next = slab_partial[run->class];
+		if(run->next != NULL) run->next->previous = run;
+		slab_partial[run->class] = run;
+	}
+
+	if(run->free_count == slab_object_count(run->class) &&
+	   (run->previous != NULL || run->next != NULL)) {
+		slab_release_run(run);
+	}
+}
+
+/*
+ * slab_new_run: carves a page-aligned run out of the heap, marks all of its
+ *               objects free and makes it the partial run of the class
+ */
+static slab_run_t *slab_new_run(int class)
+{
+	slab_run_t *run = aligned_malloc(slab_run_size, slab_run_size - dsize);
+	size_t count = slab_object_count(class);
+	int word;
+
+	if(run == NULL) return NULL;
+
+	run->previous = NULL;
+	run->next = NULL;
+	run->class = class;
+	run->free_count = count;
+	for(word = 0; word < SLAB_BITMAP_WORDS; word++) {
+		if(count >= 64) {
+			run->free_map[word] = ~(uint64_t) 0;
+			count -= 64;
+		}else{
+			run->free_map[word] = ((uint64_t) 1 << count) - 1;
+			count = 0;
+		}
+	}
+
+	set_slab_page(run, true);
+	slab_partial[class] = run;
+	return run;
+}
+
+/*
+ * slab_release_run: unlinks an entirely free run and frees its block
+ */
+static void slab_release_run(slab_run_t *run)
+{
+	if(run->previous != NULL) {
+		run->previous->next = run->next;
+	}else{
+		slab_partial[run->class] = run->next;
+	}
+	if(run->next != NULL) run->next->previous = run->previous;
+
+	set_slab_page(run, false);
+	mm_free(run);
+}
+
+/*
+ * is_slab_object: returns true when bp lies in a page that is a slab run
+ */
+static bool is_slab_object(void *bp)
+{
+	size_t page = (uintptr_t) bp / slab_run_size - (uintptr_t) mem_heap_lo() / slab_run_size;
+
+	return (slab_pagemap[page / 64] >> (page % 64)) & 1;
+}
+
+static void set_slab_page(void *run, bool is_slab)
+{
+	size_t page = (uintptr_t) run / slab_run_size - (uintptr_t) mem_heap_lo() / slab_run_size;
+
+	if(is_slab) {
+		slab_pagemap[page / 64] |= (uint64_t) 1 << (page % 64);
+		if(page > slab_pagemap_top) slab_pagemap_top = page;
+	}else{
+		slab_pagemap[page / 64] &= ~((uint64_t) 1 << (page % 64));
+	}
+}
+
+static size_t slab_object_size(int class)
+{
+	return (class + 1) * dsize;
+}
+
+static size_t slab_object_count(int class)
+{
+	size_t space = slab_run_size - dsize - round_up(sizeof(slab_run_t), dsize);
+	return space / slab_object_size(class);
+}
+
+static unsigned char *slab_objects(slab_run_t *run)
+{
+	return (unsigned char *) run + round_up(sizeof(slab_run_t), dsize);
+}
+
+/*
+ * mm_usable_size: returns the number of payload bytes behind bp, for both
+ *                 slab objects and heap blocks
+ */
+size_t mm_usable_size(void *bp)
+{
+	if(bp == NULL) return 0;
+
+	if(use_slab && is_slab_object(bp)) {
+		slab_run_t *run = (slab_run_t *) ((uintptr_t) bp & ~(uintptr_t) (slab_run_size - 1));
+		return slab_object_size(run->class);
+	}
+
+	return get_payload_size(payload_to_header(bp));
+}
+
+
+/*
+ * trim_heap: shrinks the free block at the end of the heap to at least
+ *            pad bytes and moves the break down to the page boundary after
+ *            it. Returns 1 if the heap shrank.
+ */
+static int trim_heap(size_t pad)
+{
+	size_t page = mem_hugepagesize() ? mem_hugepagesize() : mem_pagesize();
+	size_t keep = round_up(pad, dsize);
+	unsigned char *lo = (unsigned char *) mem_heap_lo();
+	unsigned char *brk = (unsigned char *) heap_end + wsize;
+
+	if(extract_alloc(*find_prev_footer(heap_end))) return 0;
+
+	block_t *block = find_prev(heap_end);
+	size_t size = get_size(block);
+
+	if(keep < min_block_size) keep = min_block_size;
+	if(size <= keep) return 0;
+
+	// The new break is page-aligned and leaves keep bytes and the epilogue
+	unsigned char *new_brk = lo + round_up((unsigned char *) block + keep + wsize - lo, page);
+	if(new_brk >= brk) return 0;
+
+	size_t release = brk - new_brk;
+
+	// The block and the epilogue only change once the break has moved
+	if(mem_sbrk(-(intptr_t) release) == (void *) -1) return 0;
+
+	disconnect_block(block);
+	write_header(block, size - release, false);
+	write_footer(block, size - release, false);
+
+	// Create new epilogue header
+	heap_end = find_next(block);
+	write_header(heap_end, 0, true);
+
+	append_free_list(block);
+	return 1;
+}
+
+/*
+ * purge_tick: advances the purge clock by one call and scans for decayed
+ *             blocks every purge_interval calls
+ */
+static void purge_tick(void)
+{
+	if(purge_clock_type == 0) purge_now++;
+
+	if(++purge_calls < purge_interval) return;
+	purge_calls = 0;
+
+	if(purge_clock_type == 1) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		purge_now = (word_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	}
+
+	purge_free_pages(purge_decay);
+}
+
+/*
+ * purge_free_pages: purges every free block of at least purge_min_size
+ *                   bytes that has not changed for decay ticks. Returns
+ *                   the bytes released.
+ */
+static size_t purge_free_pages(word_t decay)
+{
+	size_t released = 0;
+	int class;
+
+	for(class = next_nonempty_class(find_class(purge_min_size));
+	    class >= 0;
+	    class = next_nonempty_class(class + 1)) {
+		block_t *block = seg_list[class];
+
+		do{
+			unsigned char *lo, *hi;
+			size_t size;
+
+			if(get_size(block) >= purge_min_size && !is_purged(block) &&
+			   purge_now - *purge_stamp(block) >= decay &&
+			   (size = purge_range(block, &lo, &hi)) > 0 &&
+			   mem_purge(lo, size) == size) {
+				block->header |= purged_mask;
+				purged_bytes += size;
+				purged_total += size;
+				released += size;
+			}
+
+			block = block->next;
+		}while(block != seg_list[class]);
+	}
+
+	return released;
+}
+
+/*
+ * is_purged: returns true when the pages inside the free block were purged
+ */
+static bool is_purged(block_t *block)
+{
+	return (block->header & purged_mask) != 0;
+}
+
+/*
+ * purge_stamp: returns the word of a free block of at least purge_min_size
+ *              bytes that holds the purge clock when it was last freed
+ */
+static word_t *purge_stamp(block_t *block)
+{
+	return (word_t *) (&block->next + 1);
+}
+
+/*
+ * purge_range: finds the whole pages of a free block that can be purged,
+ *              all but those holding its header, links, stamp and footer.
+ *              Returns their size, 0 if there are none.
+ */
+static size_t purge_range(block_t *block, unsigned char **lo, unsigned char **hi)
+{
+	size_t page = mem_hugepagesize() ? mem_hugepagesize() : mem_pagesize();
+	uintptr_t start = (uintptr_t) (purge_stamp(block) + 1);
+	uintptr_t end = (uintptr_t) header_to_footer(block);
+
+	start = (start + page - 1) & ~(uintptr_t) (page - 1);
+	end &= ~(uintptr_t) (page - 1);
+	if(end <= start) return 0;
+
+	*lo = (unsigned char *) start;
+	*hi = (unsigned char *) end;
+	return end - start;
+}
@@ -0,0 +1,795 @@
+/*
+ ******************************************************************************
+ *                                   mm.c                                     *
+ *      64-bit struct-based Two-Level Segregated Fit (TLSF) memory allocator  *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *             Modified version of one provided to students in malloc lab     *
+ *  This version indexes free blocks by a first level power-of-two class and  *
+ *  a second level linear subdivision of it. Two levels of bitmaps make both  *
+ *  malloc and free a bounded number of steps, independent of the heap size   *
+ *                                                                            *
+ *  ************************************************************************  *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {
+		/* Team name */
+		"ateam",
+		/* First member's full name */
+		"Harry Bovik",
+		/* First member's email address */
+		"bovik@cs.cmu.edu",
+		/* Second member's full name (leave blank if none) */
+		"",
+		/* Second member's email address (leave blank if none) */
+		""
+};
+
+/* Basic constants */
+
+typedef uint64_t word_t;
+
+// Word and header size (bytes)
+static const size_t wsize = sizeof(word_t);
+
+// Double word size (bytes)
+static const size_t dsize = 2 * sizeof(word_t);
+
+/*
+  Minimum useable block size (bytes):
+  two words for header & footer, two words for payload
+*/
+static const size_t min_block_size = 4 * sizeof(word_t);
+
+// Mask to extract allocated bit from header
+static const word_t alloc_mask = 0x1;
+
+/*
+ * Assume: All block sizes are a multiple of 16
+ * and so can use lower 4 bits for flags
+ */
+static const word_t size_mask = ~(word_t) 0xF;
+
+static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
+
+/*
+  TLSF index layout.
+
+  Every first level (fl) list covers one power of two, and is cut into
+  2^SL_INDEX_COUNT_LOG2 second level (sl) lists of equal width. Blocks
+  smaller than 2^FL_INDEX_SHIFT bytes all live in first level 0, whose
+  second level lists are exactly dsize bytes apart.
+*/
+#define SL_INDEX_COUNT_LOG2 4
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + 4)      // 4 == log2(dsize)
+#define FL_INDEX_MAX 40                               // largest block < 2^40
+#define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+
+/*
+  Trimming. When mm_free leaves a free block of at least trim_threshold
+  bytes at the end of the heap, all of it but trim_pad bytes is given
+  back with a negative mem_sbrk, in whole pages. mm_trim(pad) does the
+  same on request, whatever the size of the block. A front end can turn
+  the trimming by mm_free off with mm_auto_trim.
+*/
+static const bool use_trim = true;
+static const size_t trim_threshold = (1 << 17);
+static const size_t trim_pad = (1 << 16);
+
+/*
+  All blocks have both headers and footers
+
+  Both the header and the footer consist of a single word containing the
+  size and the allocation flag, where size is the total size of the block,
+  including header, (possibly payload), unused space, and footer
+*/
+
+/* Representation of the header and payload of one block in the heap */
+typedef struct block
+{
+	word_t header;
+	/*
+	 * We don't know what the size of the payload will be, so we will
+	 * declare it as a zero-length array.  This allow us to obtain a
+	 * pointer to the start of the payload.
+	 */
+
+	unsigned char payload[0];
+	struct block *previous;
+	struct block *next;
+
+} block_t;
+
+
+/* Global variables */
+
+// Cleared by a front end that frees from a thread the heap may be reset under
+static bool auto_trim = true;
+
+// Pointer to first block
+static block_t *heap_start = NULL;
+// Pointer to last block.  This is an empty, but allocated block
+static block_t *heap_end = NULL;
+
+// Bit fl is set when some list of first level fl is non-empty
+static uint64_t fl_bitmap;
+// Bit sl of sl_bitmap[fl] is set when free_lists[fl][sl] is non-empty
+static uint32_t sl_bitmap[FL_INDEX_COUNT];
+// Head of the NULL terminated free list of every (fl, sl) pair
+static block_t *free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+/* Function prototypes for internal helper routines */
+
+static block_t *find_fit(size_t asize);
+static block_t *coalesce_block(block_t *block);
+static void split_block(block_t *block, size_t asize);
+
+static size_t round_up(size_t size, size_t n);
+static word_t pack(size_t size, bool alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc);
+static void write_footer(block_t *block, size_t size, bool alloc);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+static word_t *header_to_footer(block_t *block);
+
+static block_t *find_next(block_t *block);
+static word_t *find_prev_footer(block_t *block);
+static block_t *find_prev(block_t *block);
+static block_t *extend_heap(size_t size);
+void mm_status();
+static word_t get_payload_size(block_t *block);
+
+// functions only for TLSF
+void free_list_status();
+static int fls_size(size_t size);
+static void mapping_insert(size_t size, int *fl, int *sl);
+static void mapping_search(size_t size, int *fl, int *sl);
+static void append_free_list(block_t *block);
+static void disconnect_block(block_t *block);
+
+// functions only for trimming
+int mm_trim(size_t pad);
+void mm_auto_trim(bool enable);
+static int trim_heap(size_t pad);
+
+void log_block(block_t *block){
+	bool is_allocate = get_alloc(block);
+	printf("Block address %p,  size = %zd, allocated = %s, ",
+	       block,
+	       get_size(block),
+	       is_allocate ? "Y" : "N");
+
+	if(!is_allocate) {
+		block_t *prev_free = block->previous, *next_free = block->next;
+		printf("prev_free_block = %p, next_free_block = %p", prev_free, next_free);
+	}
+
+	printf("\n");
+}
+
+
+/*
+  Initialize a heap to have byte_count bytes starting at address start.
+  Assume start and byte_count are multiples of dsize.
+ */
+int mm_init()
+{
+	word_t *start = (word_t*)(mem_sbrk(2 * wsize));
+	if(start == (void *)-1) {
+		return -1;
+	}
+
+	start[0] = pack(0, true); // Prologue footer
+	start[1] = pack(0, true); // Epilogue header
+
+	heap_end = (block_t *) &start[1];
+	fl_bitmap = 0;
+	memset(sl_bitmap, 0, sizeof(sl_bitmap));
+	memset(free_lists, 0, sizeof(free_lists));
+
+	// Extend the empty heap with a free block of chunksize bytes
+	if ((heap_start = extend_heap(chunksize)) == NULL)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Allocate space for payload of size bytes
+ */
+void *mm_malloc(size_t size)
+{
+	size_t asize;      // Allocated block size
+	block_t *block = NULL;
+	void *bp = NULL;
+
+	if (size == 0) // Ignore spurious request
+		return bp;
+
+	asize = round_up(size + dsize, dsize);
+	if((block = find_fit(asize)) == NULL) {
+		// No list is guaranteed to fit, grow the heap
+		size_t extend_size = asize > chunksize ? asize : chunksize;
+		if((block = extend_heap(extend_size)) == NULL) {
+			return NULL;
+		}
+	}
+
+	disconnect_block(block);
+
+	// Mark block as allocated
+	size_t block_size = get_size(block);
+	write_header(block, block_size, true);
+	write_footer(block, block_size, true);
+
+	// Try to split the block if too large
+	split_block(block, asize);
+	bp = header_to_payload(block);
+
+	return bp;
+}
+
+/* Free allocated block */
+void mm_free(void *bp)
+{
+	if (bp == NULL)
+		return;
+
+	block_t *block = payload_to_header(bp);
+	size_t size = get_size(block);
+
+	// The block should be marked as allocated
+	if (!get_alloc(block)) {
+		fprintf(stderr, "ERROR.  Attempted to free unallocated block\n");
+		exit(1);
+	}
+
+	// Mark the block as free
+	write_header(block, size, false);
+	write_footer(block, size, false);
+
+	// Immediately coalesce the block with its neighbors
+	block = coalesce_block(block);
+
+	// A large free block at the end of the heap goes back to the system
+	if (use_trim && auto_trim && find_next(block) == heap_end && get_size(block) >= trim_threshold)
+		trim_heap(trim_pad);
+}
+
+/*
+ * Give the free block at the end of the heap back to the system, all but
+ * pad bytes of it. Returns 1 if the heap shrank.
+ */
+int mm_trim(size_t pad)
+{
+	return trim_heap(pad);
+}
+
+/*
+ * Turn the trimming by mm_free on or off. mm_trim works either way.
+ */
+void mm_auto_trim(bool enable)
+{
+	auto_trim = enable;
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+	size_t copysize;
+	void *newptr;
+
+	// If size == 0, then free block and return NULL
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+
+	// If ptr is NULL, then equivalent to malloc
+	if (ptr == NULL)
+	{
+		return mm_malloc(size);
+	}
+
+	// Otherwise, proceed with reallocation
+	newptr = mm_malloc(size);
+	// If malloc fails, the original block is left untouched
+	if (!newptr)
+	{
+		return NULL;
+	}
+
+	// Copy the old data
+	copysize = get_payload_size(payload_to_header(ptr)); // gets size of old payload
+	if(size < copysize)
+	{
+		copysize = size;
+	}
+	memcpy(newptr, ptr, copysize);
+
+	// Free the old block
+	mm_free(ptr);
+
+	return newptr;
+}
+
+/* Return the number of payload bytes usable behind an allocated ptr */
+size_t mm_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return get_payload_size(payload_to_header(ptr));
+}
+
+/* Print status of every block in heap */
+void mm_status() {
+	block_t *block = heap_start;
+	printf("The whole heap status\n");
+	printf("*******************************\n");
+	while (block != heap_end) {
+		log_block(block);
+		block = find_next(block);
+	}
+	printf("Head End: ");
+	log_block(heap_end);
+	printf("*******************************\n");
+}
+
+/* Print every non-empty (fl, sl) list */
+void free_list_status() {
+	int fl, sl;
+
+	printf("fl_bitmap = %#" PRIx64 "\n", fl_bitmap);
+	for(fl = 0; fl < FL_INDEX_COUNT; fl++) {
+		for(sl = 0; sl < SL_INDEX_COUNT; sl++) {
+			block_t *block = free_lists[fl][sl];
+			if(block == NULL) continue;
+
+			printf("List (%d, %d)\n", fl, sl);
+			printf("-------------------------------\n");
+			for(; block != NULL; block = block->next) {
+				log_block(block);
+			}
+			printf("-------------------------------\n");
+		}
+	}
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+
+/*
+ * Attempt to coalesce block with its predecessor and successor through
+ * the boundary tags, then put the result into its list. Returns the
+ * coalesced block.
+ */
+static block_t *coalesce_block(block_t *block)
+{
+	size_t size = get_size(block);
+
+	block_t *block_next = find_next(block);
+	block_t *block_prev = find_prev(block);
+
+	bool prev_alloc = extract_alloc(*find_prev_footer(block));
+	bool next_alloc = get_alloc(block_next);
+
+	if (prev_alloc && next_alloc)              // Case 1
+	{
+		//Nothing to do
+	}
+
+	else if (prev_alloc && !next_alloc)        // Case 2
+	{
+		disconnect_block(block_next);
+
+		size += get_size(block_next);
+		write_header(block, size, false);
+		write_footer(block, size, false);
+	}
+
+	else if (!prev_alloc && next_alloc)        // Case 3
+	{
+		disconnect_block(block_prev);
+
+		size += get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	else                                        // Case 4
+	{
+		disconnect_block(block_prev);
+		disconnect_block(block_next);
+
+		size += get_size(block_next) + get_size(block_prev);
+		write_header(block_prev, size, false);
+		write_footer(block_prev, size, false);
+		block = block_prev;
+	}
+
+	append_free_list(block);
+	return block;
+}
+
+
+/*
+ * See if new block can be split one to satisfy allocation
+ * and one to keep free. The block must already be off its free list.
+ */
+static void split_block(block_t *block, size_t asize)
+{
+	size_t block_size = get_size(block);
+
+	if ((block_size - asize) >= min_block_size)
+	{
+		write_header(block, asize, true);
+		write_footer(block, asize, true);
+
+		block_t *block_next = find_next(block);
+		write_header(block_next, block_size - asize, false);
+		write_footer(block_next, block_size - asize, false);
+
+		// The block after the remainder is allocated, no need to coalesce
+		append_free_list(block_next);
+	}
+}
+
+
+/*
+ * Find a free block of size at least asize in constant time. The request
+ * is rounded up to the next list boundary, so the head of any list at or
+ * above (fl, sl) fits without looking at the block sizes.
+ */
+static block_t *find_fit(size_t asize) {
+	int fl, sl;
+	uint32_t sl_map;
+	uint64_t fl_map;
+
+	mapping_search(asize, &fl, &sl);
+	if(fl >= FL_INDEX_COUNT) return NULL;
+
+	// first try the lists of the same first level, from sl upwards
+	sl_map = sl_bitmap[fl] & (~(uint32_t) 0 << sl);
+	if(sl_map == 0) {
+		// then the smallest non-empty first level above fl
+		fl_map = (fl + 1 < 64) ? fl_bitmap & (~(uint64_t) 0 << (fl + 1)) : 0;
+		if(fl_map == 0) return NULL; // no fit found
+
+		fl = __builtin_ctzll(fl_map);
+		sl_map = sl_bitmap[fl];
+	}
+
+	sl = __builtin_ctz(sl_map);
+	return free_lists[fl][sl];
+}
+
+/*
+ * Grow the heap by size bytes and return the (coalesced) free block
+ * at the end of the heap
+ */
+static block_t *extend_heap(size_t size)
+{
+	void *bp;
+
+	// Allocate an even number of words to maintain alignment
+	size = round_up(size, dsize);
+	// On huge pages, grow up to the next huge page boundary
+	if (mem_hugepagesize() != 0)
+		size = round_up(mem_heapsize() + size, mem_hugepagesize()) - mem_heapsize();
+	if ((bp = mem_sbrk(size)) == (void *)-1)
+	{
+		return NULL;
+	}
+
+	// Initialize free block header/footer
+	block_t *block = payload_to_header(bp);
+	write_header(block, size, false);
+	write_footer(block, size, false);
+	// Create new epilogue header
+	block_t *block_next = find_next(block);
+	write_header(block_next, 0, true);
+	heap_end = block_next;
+
+	// Coalesce in case the previous block was free
+	return coalesce_block(block);
+}
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+	return n * ((size + (n-1)) / n);
+}
+
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ */
+static word_t pack(size_t size, bool alloc)
+{
+	return alloc ? (size | alloc_mask) : size;
+}
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+	return (word & size_mask);
+}
+
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the heap is 16-byte aligned).
+ */
+static size_t get_size(block_t *block)
+{
+	return extract_size(block->header);
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+	return (bool) (word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+	return extract_alloc(block->header);
+}
+
+
+/*
+ * write_header: given a block and its size and allocation status,
+ *               writes an appropriate value to the block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc)
+{
+	block->header = pack(size, alloc);
+}
+
+
+/*
+ * write_footer: given a block and its size and allocation status,
+ *               writes an appropriate value to the block footer by first
+ *               computing the position of the footer.
+ */
+static void write_footer(block_t *block, size_t size, bool alloc)
+{
+	word_t *footerp = header_to_footer(block);
+	*footerp = pack(size, alloc);
+}
+
+
+/*
+ * find_next: returns the next consecutive block on the heap by adding the
+ *            size of the block.
+ */
+static block_t *find_next(block_t *block)
+{
+	return (block_t *) ((unsigned char *) block + get_size(block));
+}
+
+
+/*
+ * find_prev_footer: returns the footer of the previous block.
+ */
+static word_t *find_prev_footer(block_t *block)
+{
+	// Compute previous footer position as one word before the header
+	return &(block->header) - 1;
+}
+
+
+/*
+ * find_prev: returns the previous block position by checking the previous
+ *            block's footer and calculating the start of the previous block
+ *            based on its size.
+ */
+static block_t *find_prev(block_t *block)
+{
+	word_t *footerp = find_prev_footer(block);
+	size_t size = extract_size(*footerp);
+	return (block_t *) ((unsigned char *) block - size);
+}
+
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+	return (block_t *) ((unsigned char *) bp - offsetof(block_t, payload));
+}
+
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+	return (void *) (block->payload);
+}
+
+
+/*
+ * header_to_footer: given a block pointer, returns a pointer to the
+ *                   corresponding footer.
+ */
+static word_t *header_to_footer(block_t *block)
+{
+	return (word_t *) (block->payload + get_size(block) - dsize);
+}
+
+static word_t get_payload_size(block_t *block)
+{
+	size_t asize = get_size(block);
+	return asize - dsize;
+}
+
+
+/*
+ * fls_size: returns the index of the most significant set bit of size
+ */
+static int fls_size(size_t size)
+{
+	return 63 - __builtin_clzll((unsigned long long) size);
+}
+
+/*
+ * mapping_insert: computes the (fl, sl) list a free block of the given
+ *                 size belongs to
+ */
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+	int log_size;
+
+	if(size < ((size_t) 1 << FL_INDEX_SHIFT)) {
+		// small blocks: linear lists dsize bytes apart
+		*fl = 0;
+		*sl = size / dsize;
+		return;
+	}
+
+	log_size = fls_size(size);
+	*sl = (int) (size >> (log_size - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+	*fl = log_size - FL_INDEX_SHIFT + 1;
+}
+
+/*
+ * mapping_search: like mapping_insert, but first rounds size up to the
+ *                 next list boundary so that every block of the returned
+ *                 list is at least size bytes
+ */
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+	if(size >= ((size_t) 1 << FL_INDEX_SHIFT)) {
+		size += ((size_t) 1 << (fls_size(size) - SL_INDEX_COUNT_LOG2)) - 1;
+	}
+
+	mapping_insert(size, fl, sl);
+}
+
+// push the block on the head of its (fl, sl) list
+static void append_free_list(block_t *block) {
+	int fl, sl;
+
+	if(get_alloc(block)) {
+		fprintf(stderr, "Cannot add an allocated ptr to the free list\n");
+		exit(-1);
+	}
+
+	mapping_insert(get_size(block), &fl, &sl);
+
+	block->previous = NULL;
+	block->next = free_lists[fl][sl];
+	if(block->next != NULL) block->next->previous = block;
+	free_lists[fl][sl] = block;
+
+	fl_bitmap |= (uint64_t) 1 << fl;
+	sl_bitmap[fl] |= (uint32_t) 1 << sl;
+}
+
+// take the block out of its (fl, sl) list
+static void disconnect_block(block_t *block) {
+	int fl, sl;
+
+	mapping_insert(get_size(block), &fl, &sl);
+
+	if(block->previous != NULL) {
+		block->previous->next = block->next;
+	}else{
+		free_lists[fl][sl] = block->next;
+	}
+	if(block->next != NULL) block->next->previous = block->previous;
+
+	if(free_lists[fl][sl] == NULL) {
+		sl_bitmap[fl] &= ~((uint32_t) 1 << sl);
+		if(sl_bitmap[fl] == 0) fl_bitmap &= ~((uint64_t) 1 << fl);
+	}
+}
+
+/*
+ * trim_heap: shrinks the free block at the end of the heap to at least
+ *            pad bytes and moves the break down to the page boundary after
+ *            it. Returns 1 if the heap shrank.
+ */
+static int trim_heap(size_t pad)
+{
+	size_t page = mem_hugepagesize() ? mem_hugepagesize() : mem_pagesize();
+	size_t keep = round_up(pad, dsize);
+	unsigned char *lo = (unsigned char *) mem_heap_lo();
+	unsigned char *brk = (unsigned char *) heap_end + wsize;
+
+	if(extract_alloc(*find_prev_footer(heap_end))) return 0;
+
+	block_t *block = find_prev(heap_end);
+	size_t size = get_size(block);
+
+	if(keep < min_block_size) keep = min_block_size;
+	if(size <= keep) return 0;
+
+	// The new break is page-aligned and leaves keep bytes and the epilogue
+	unsigned char *new_brk = lo + round_up((unsigned char *) block + keep + wsize - lo, page);
+	if(new_brk >= brk) return 0;
+
+	size_t release = brk - new_brk;
+
+	// The block and the epilogue only change once the break has moved
+	if(mem_sbrk(-(intptr_t) release) == (void *) -1) return 0;
+
+	disconnect_block(block);
+	write_header(block, size - release, false);
+	write_footer(block, size - release, false);
+
+	// Create new epilogue header
+	heap_end = find_next(block);
+	write_header(heap_end, 0, true);
+
+	append_free_list(block);
+	return 1;
+}